@@ -0,0 +1,133 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "acthyb.h"
+#include "redfsm.h"
+#include "gendata.h"
+
+static bool refsOfType( RedAction *redAct, ActHyb::RefType refType )
+{
+	switch ( refType ) {
+		case ActHyb::FromStateRefs:
+			return redAct->numFromStateRefs > 0;
+		case ActHyb::TransRefs:
+			return redAct->numTransRefs > 0;
+		case ActHyb::ToStateRefs:
+			return redAct->numToStateRefs > 0;
+	}
+	return false;
+}
+
+/* Picks the lists to expand on first use. A list is hot when it runs on at
+ * least the threshold percentage of the input keys. */
+bool ActHyb::anyHot( RefType refType )
+{
+	if ( hotLists == 0 ) {
+		double *freq = redFsm->actionListFreq();
+		hotLists = new bool[redFsm->actionMap.length() + 1];
+		for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+			hotLists[redAct->actListId] =
+					freq[redAct->actListId] * 100 >= red->id->hybridThreshold;
+		}
+		delete[] freq;
+	}
+
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( hotLists[redAct->actListId] && refsOfType( redAct, refType ) )
+			return true;
+	}
+	return false;
+}
+
+/* Cases for the hot lists. They are keyed on the offset into the actions
+ * array plus one, which is what the action tables hold for the loop. */
+void ActHyb::EXPANDED_CASES( RefType refType )
+{
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( hotLists[redAct->actListId] && refsOfType( redAct, refType ) ) {
+			/* Write the entry label. */
+			out << "\t " << CASE( STR( redAct->location+1 ) ) << " {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ ) {
+				ACTION( out, item->value, IlOpts( 0, false, false ) );
+				out << "\n\t";
+			}
+
+			out << "\n\t" << CEND() << "\n}\n";
+		}
+	}
+}
+
+void ActHyb::FROM_STATE_ACTIONS()
+{
+	if ( !redFsm->anyFromStateActions() || !anyHot( FromStateRefs ) ) {
+		ActLoop::FROM_STATE_ACTIONS();
+		return;
+	}
+
+	out <<
+		"	switch ( " << ARR_REF( fromStateActions ) << "[" << vCS() << "] ) {\n";
+	EXPANDED_CASES( FromStateRefs );
+	out << "\t " << DEFAULT() << " {\n";
+	ActLoop::FROM_STATE_ACTIONS();
+	out <<
+		"\n\t" << CEND() << "\n}\n"
+		"	}\n"
+		"\n";
+}
+
+void ActHyb::REG_ACTIONS( std::string cond )
+{
+	if ( !anyHot( TransRefs ) ) {
+		ActLoop::REG_ACTIONS( cond );
+		return;
+	}
+
+	out <<
+		"	switch ( " << ARR_REF( condActions ) << "[" << cond << "] ) {\n";
+	EXPANDED_CASES( TransRefs );
+	out << "\t " << DEFAULT() << " {\n";
+	ActLoop::REG_ACTIONS( cond );
+	out <<
+		"\n\t" << CEND() << "\n}\n"
+		"	}\n"
+		"\n";
+}
+
+void ActHyb::TO_STATE_ACTIONS()
+{
+	if ( !redFsm->anyToStateActions() || !anyHot( ToStateRefs ) ) {
+		ActLoop::TO_STATE_ACTIONS();
+		return;
+	}
+
+	out <<
+		"	switch ( " << ARR_REF( toStateActions ) << "[" << vCS() << "] ) {\n";
+	EXPANDED_CASES( ToStateRefs );
+	out << "\t " << DEFAULT() << " {\n";
+	ActLoop::TO_STATE_ACTIONS();
+	out <<
+		"\n\t" << CEND() << "\n}\n"
+		"	}\n"
+		"\n";
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _ACTHYB_H
+#define _ACTHYB_H
+
+#include "actloop.h"
+#include "bingoto.h"
+#include "flatgoto.h"
+
+/*
+ * Action lists run by the loop over the actions array, except the lists run
+ * often enough by the estimate from the input histogram. Those are expanded in
+ * a switch on the action table value ahead of the loop. The tables are the
+ * same as with the loop styles.
+ */
+class ActHyb
+	: public ActLoop
+{
+public:
+	ActHyb( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		ActLoop( args ),
+		hotLists( 0 )
+	{}
+
+	~ActHyb()
+	{
+		delete[] hotLists;
+	}
+
+	enum RefType { FromStateRefs, TransRefs, ToStateRefs };
+
+	bool *hotLists;
+
+	bool anyHot( RefType refType );
+	void EXPANDED_CASES( RefType refType );
+
+	virtual void FROM_STATE_ACTIONS();
+	virtual void REG_ACTIONS( std::string cond );
+	virtual void TO_STATE_ACTIONS();
+};
+
+class BinGotoHyb
+	: public BinGoto, public ActHyb
+{
+public:
+	BinGotoHyb( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		BinGoto( args, Loop ),
+		ActHyb( args )
+	{}
+};
+
+class FlatGotoHyb
+	: public FlatGoto, public ActHyb
+{
+public:
+	FlatGotoHyb( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		FlatGoto( args, Loop ),
+		ActHyb( args )
+	{}
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "actthr.h"
+#include "redfsm.h"
+#include "gendata.h"
+
+static bool refsOfType( RedAction *redAct, ActThr::RefType refType )
+{
+	switch ( refType ) {
+		case ActThr::FromStateRefs:
+			return redAct->numFromStateRefs > 0;
+		case ActThr::TransRefs:
+			return redAct->numTransRefs > 0;
+		case ActThr::ToStateRefs:
+			return redAct->numToStateRefs > 0;
+	}
+	return false;
+}
+
+/* Write a jump through a table of label addresses. The table is indexed by
+ * action list id plus one, the same as the switch. Zero and any id not used
+ * from this point go to the end label. */
+void ActThr::LABEL_DISPATCH( std::string tab, std::string index, RefType refType )
+{
+	int numIds = redFsm->actionMap.length() + 1;
+	bool *used = new bool[numIds];
+	memset( used, 0, sizeof(bool) * numIds );
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( refsOfType( redAct, refType ) )
+			used[redAct->actListId+1] = true;
+	}
+
+	out <<
+		"	{\n"
+		"	static void *" << tab << "[] = {";
+
+	for ( int id = 0; id < numIds; id++ ) {
+		if ( id > 0 )
+			out << ", ";
+		if ( id % 8 == 0 )
+			out << "\n		";
+		out << "&&" << tab << "_" << ( used[id] ? id : 0 );
+	}
+
+	out <<
+		"\n	};\n"
+		"	goto *" << tab << "[" << index << "];\n";
+
+	for ( GenActionTableMap::Iter redAct = redFsm->actionMap; redAct.lte(); redAct++ ) {
+		if ( used[redAct->actListId+1] ) {
+			/* Write the entry label. */
+			out << tab << "_" << redAct->actListId+1 << ": {\n";
+
+			/* Write each action in the list of action items. */
+			for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ ) {
+				ACTION( out, item->value, IlOpts( 0, false, false ) );
+				out << "\n\t";
+			}
+
+			out << "\n\t}\n\tgoto " << tab << "_0;\n";
+		}
+	}
+
+	out <<
+		tab << "_0: ;\n"
+		"	}\n";
+
+	delete[] used;
+}
+
+void ActThr::FROM_STATE_ACTIONS()
+{
+	if ( backend != Direct ) {
+		ActExp::FROM_STATE_ACTIONS();
+		return;
+	}
+
+	if ( redFsm->anyFromStateActions() ) {
+		out << "#if defined(__GNUC__)\n";
+		LABEL_DISPATCH( "_fsa", ARR_REF( fromStateActions ) + "[" + vCS() + "]",
+				FromStateRefs );
+		out << "#else\n";
+		ActExp::FROM_STATE_ACTIONS();
+		out << "#endif\n";
+	}
+}
+
+void ActThr::REG_ACTIONS( std::string cond )
+{
+	if ( backend != Direct ) {
+		ActExp::REG_ACTIONS( cond );
+		return;
+	}
+
+	out << "#if defined(__GNUC__)\n";
+	LABEL_DISPATCH( "_ca", ARR_REF( condActions ) + "[" + cond + "]", TransRefs );
+	out << "#else\n";
+	ActExp::REG_ACTIONS( cond );
+	out << "#endif\n";
+}
+
+void ActThr::TO_STATE_ACTIONS()
+{
+	if ( backend != Direct ) {
+		ActExp::TO_STATE_ACTIONS();
+		return;
+	}
+
+	if ( redFsm->anyToStateActions() ) {
+		out << "#if defined(__GNUC__)\n";
+		LABEL_DISPATCH( "_tsa", ARR_REF( toStateActions ) + "[" + vCS() + "]",
+				ToStateRefs );
+		out << "#else\n";
+		ActExp::TO_STATE_ACTIONS();
+		out << "#endif\n";
+	}
+}
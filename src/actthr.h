@@ -0,0 +1,79 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _ACTTHR_H
+#define _ACTTHR_H
+
+#include "actexp.h"
+#include "bingoto.h"
+#include "flatgoto.h"
+
+/*
+ * Expanded actions dispatched through a table of label addresses (a GNU C
+ * extension) instead of a switch. The output keeps the switch behind an
+ * #else for compilers without the extension, and other backends get the
+ * switch only.
+ */
+class ActThr
+	: public ActExp
+{
+public:
+	ActThr( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		ActExp( args )
+	{}
+
+	enum RefType { FromStateRefs, TransRefs, ToStateRefs };
+
+	void LABEL_DISPATCH( std::string tab, std::string index, RefType refType );
+
+	virtual void FROM_STATE_ACTIONS();
+	virtual void REG_ACTIONS( std::string cond );
+	virtual void TO_STATE_ACTIONS();
+};
+
+class BinGotoThr
+	: public BinGoto, public ActThr
+{
+public:
+	BinGotoThr( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		BinGoto( args, Expand ),
+		ActThr( args )
+	{}
+};
+
+class FlatGotoThr
+	: public FlatGoto, public ActThr
+{
+public:
+	FlatGotoThr( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		FlatGoto( args, Expand ),
+		ActThr( args )
+	{}
+};
+
+#endif
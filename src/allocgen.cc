@@ -42,6 +42,10 @@
 #include "gotoloop.h"
 #include "gotoexp.h"
 #include "ipgoto.h"
+#include "actthr.h"
+#include "acthyb.h"
+#include "keyhash.h"
+#include "lazydfa.h"
 #include "asm.h"
 
 CodeGenData *makeCodeGenAsm( const HostLang *hostLang, const CodeGenArgs &args )
@@ -77,6 +81,33 @@ CodeGenData *makeCodeGen( const HostLang *hostLang, const CodeGenArgs &args )
 			codeGen = new BinVarExp( args );
 		break;
 
+	case GenBinaryThr:
+		if ( feature == GotoFeature )
+			codeGen = new BinGotoThr( args );
+		else if ( feature == BreakFeature )
+			codeGen = new BinBreakExp( args );
+		else
+			codeGen = new BinVarExp( args );
+		break;
+
+	case GenBinaryHyb:
+		if ( feature == GotoFeature )
+			codeGen = new BinGotoHyb( args );
+		else if ( feature == BreakFeature )
+			codeGen = new BinBreakLoop( args );
+		else
+			codeGen = new BinVarLoop( args );
+		break;
+
+	case GenKeywordHash:
+		if ( feature == GotoFeature )
+			codeGen = new KeywordHash( args );
+		else if ( feature == BreakFeature )
+			codeGen = new BinBreakLoop( args );
+		else
+			codeGen = new BinVarLoop( args );
+		break;
+
 	case GenFlatLoop:
 		if ( feature == GotoFeature )
 			codeGen = new FlatGotoLoop( args );
@@ -94,6 +125,25 @@ CodeGenData *makeCodeGen( const HostLang *hostLang, const CodeGenArgs &args )
 		else
 			codeGen = new FlatVarExp( args );
 		break;
+
+	case GenFlatThr:
+		if ( feature == GotoFeature )
+			codeGen = new FlatGotoThr( args );
+		else if ( feature == BreakFeature )
+			codeGen = new FlatBreakExp( args );
+		else
+			codeGen = new FlatVarExp( args );
+		break;
+
+	case GenFlatHyb:
+		if ( feature == GotoFeature )
+			codeGen = new FlatGotoHyb( args );
+		else if ( feature == BreakFeature )
+			codeGen = new FlatBreakLoop( args );
+		else
+			codeGen = new FlatVarLoop( args );
+		break;
+
 	case GenSwitchLoop:
 		if ( feature == GotoFeature )
 			codeGen = new SwitchGotoLoop( args );
@@ -132,6 +182,13 @@ CodeGenData *makeCodeGen( const HostLang *hostLang, const CodeGenArgs &args )
 		else
 			id->error() << "unsupported lang/style combination" << endp;
 		break;
+
+	case GenLazyDfa:
+		if ( feature == GotoFeature && hostLang->backend == Direct )
+			codeGen = new LazyDfa( args );
+		else
+			id->error() << "the lazy DFA runtime is only available for C" << endp;
+		break;
 	}
 
 	return codeGen;
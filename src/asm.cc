@@ -44,7 +44,6 @@ using std::ios;
 using std::cin;
 using std::endl;
 
-extern int numSplitPartitions;
 bool printStatistics = false;
 
 /* Enables transition logging in the form that score-based state sorting can
@@ -72,7 +71,9 @@ AsmCodeGen::AsmCodeGen( const CodeGenArgs &args )
 :
 	CodeGenData( args ),
 	nextLmSwitchLabel( 1 ),
-	stackCS( false )
+	stackCS( false ),
+	unroll( args.id->asmUnroll ),
+	unrollCopy( -1 )
 {
 }
 
@@ -144,6 +145,14 @@ string AsmCodeGen::PE()
 	return ret.str();
 }
 
+/* The previous state. Unrolled code keeps it in a callee-save register. */
+string AsmCodeGen::PS()
+{
+	if ( unroll > 0 )
+		return "%rbx";
+	return "-72(%rbp)";
+}
+
 string AsmCodeGen::vCS()
 {
 	ostringstream ret;
@@ -866,6 +875,22 @@ string AsmCodeGen::LABEL( const char *name )
 	return s.str();
 }
 
+/* Label inside copy number copy of the unrolled states. */
+string AsmCodeGen::UNROLL_LABEL( const char *type, int copy, long i )
+{
+	std::stringstream s;
+	s << ".L" << red->machineId << "_u" << copy << "_" << type << "_" << i;
+	return s.str();
+}
+
+/* Label local to a state's search. Unrolled copies of a state need their own. */
+string AsmCodeGen::CLABEL( const char *type, long i )
+{
+	if ( unrollCopy < 0 )
+		return LABEL( type, i );
+	return UNROLL_LABEL( type, unrollCopy, i );
+}
+
 void AsmCodeGen::emitSingleIfElseIf( RedStateAp *state )
 {
 	/* Load up the singles. */
@@ -889,20 +914,20 @@ void AsmCodeGen::emitSingleJumpTable( RedStateAp *state, string def )
 	long long high = data[numSingles-1].lowKey.getVal();
 
 	if ( def.size() == 0 )
-		def = LABEL( "sjf", state->id );
+		def = CLABEL( "sjf", state->id );
 
 	out <<
 		"	movzbq	%r10b, %rax\n"
 		"	subq	$" << low << ", %rax\n"
 		"	cmpq	$" << (high - low) << ", %rax\n"
 		"	ja		" << def << "\n"
-		"	leaq	" << LABEL( "sjt", state->id ) << "(%rip), %rcx\n"
+		"	leaq	" << CLABEL( "sjt", state->id ) << "(%rip), %rcx\n"
 		"	movslq  (%rcx,%rax,4), %rdx\n"
 		"	addq	%rcx, %rdx\n"
 		"	jmp     *%rdx\n"
 		"	.section .rodata\n"
 		"	.align 4\n"
-		<< LABEL( "sjt", state->id ) << ":\n";
+		<< CLABEL( "sjt", state->id ) << ":\n";
 
 	for ( long long j = 0; j < numSingles; j++ ) {
 		/* Fill in gap between prev and this. */
@@ -910,17 +935,17 @@ void AsmCodeGen::emitSingleJumpTable( RedStateAp *state, string def )
 			long long span = keyOps->span( data[j-1].lowKey, data[j].lowKey ) - 2;
 			for ( long long k = 0; k < span; k++ ) {
 				out << "	.long	" << def << " - " <<
-						LABEL( "sjt", state->id ) << "\n";
+						CLABEL( "sjt", state->id ) << "\n";
 			}
 		}
 
 		out << "	.long	" << TRANS_GOTO_TARG( data[j].value ) << " - " <<
-				LABEL( "sjt", state->id ) << "\n";
+				CLABEL( "sjt", state->id ) << "\n";
 	}
 
 	out <<
 		"	.text\n"
-		"" << LABEL( "sjf", state->id ) << ":\n";
+		"" << CLABEL( "sjf", state->id ) << ":\n";
 }
 
 
@@ -944,7 +969,7 @@ void AsmCodeGen::emitRangeBSearch( RedStateAp *state, int low, int high )
 
 	/* For some reason the hop is faster and results in smaller code. Not sure
 	 * why. */
-	string nf = LABEL( "nf", state->id );
+	string nf = CLABEL( "nf", state->id );
 
 	if ( anyLower && anyHigher ) {
 		int l1 = nl++;
@@ -1097,30 +1122,30 @@ void AsmCodeGen::emitCharClassJumpTable( RedStateAp *st, string def )
 	long long high = st->high;
 
 	if ( def.size() == 0 )
-		def = LABEL( "ccf", st->id );
+		def = CLABEL( "ccf", st->id );
 
 	out <<
 		"	movzbq	%r10b, %rax\n"
 		"	subq	$" << low << ", %rax\n"
 		"	cmpq	$" << (high - low) << ", %rax\n"
 		"	ja		" << def << "\n"
-		"	leaq	" << LABEL( "cct", st->id ) << "(%rip), %rcx\n"
+		"	leaq	" << CLABEL( "cct", st->id ) << "(%rip), %rcx\n"
 		"	movslq  (%rcx,%rax,4), %rdx\n"
 		"	addq	%rcx, %rdx\n"
 		"	jmp     *%rdx\n"
 		"	.section .rodata\n"
 		"	.align 4\n"
-		<< LABEL( "cct", st->id ) << ":\n";
+		<< CLABEL( "cct", st->id ) << ":\n";
 
 	long long span = st->high - st->low + 1;
 	for ( long long pos = 0; pos < span; pos++ ) {
 		out << "	.long	" << TRANS_GOTO_TARG( st->transList[pos] ) << " - " <<
-				LABEL( "cct", st->id ) << "\n";
+				CLABEL( "cct", st->id ) << "\n";
 	}
 
 	out <<
 		"	.text\n"
-		"" << LABEL( "ccf", st->id ) << ":\n";
+		"" << CLABEL( "ccf", st->id ) << ":\n";
 }
 
 void AsmCodeGen::NFA_PUSH( RedStateAp *st )
@@ -1159,6 +1184,123 @@ void AsmCodeGen::NFA_PUSH( RedStateAp *st )
 	}
 }
 
+void AsmCodeGen::CHAR_CLASS_SEARCH( RedStateAp *st )
+{
+	long lowKey = redFsm->lowKey.getVal();
+	long highKey = redFsm->highKey.getVal();
+
+	out <<
+		"	movzbl	(" << P() << "), %r10d\n"
+		"	cmpl	$" << lowKey << ", %r10d\n"
+		"	jl		" << CLABEL( "nf", st->id ) << "\n"
+		"	cmpl	$" << highKey << ", %r10d\n"
+		"	jg		" << CLABEL( "nf", st->id ) << "\n"
+		"	subl	" << KEY( lowKey ) << ", %r10d\n"
+		"	leaq	" << LABEL( "char_class" ) << "(%rip), %rcx\n"
+		"	movslq	%r10d, %rax\n"
+		"	movb	(%rcx, %rax), %r10b\n"
+	;
+
+	long len = ( st->high - st->low + 1 );
+
+	if ( len < 8 )
+		emitCharClassIfElseIf( st );
+	else {
+		string def;
+		if ( st->outRange.length() == 0 )
+			def = TRANS_GOTO_TARG( st->defTrans );
+		emitCharClassJumpTable( st, def );
+	}
+}
+
+/* Search on the character itself when the state's ranges allow it, saving the
+ * load from char_class. A few ranges get a binary search, many singles packed
+ * close together a jump table. Everything else goes by character class. The
+ * byte compares are signed, so keys must be too. */
+void AsmCodeGen::UNROLLED_SEARCH( RedStateAp *st )
+{
+	int numRanges = st->outRange.length();
+	if ( numRanges == 0 )
+		return;
+
+	RedTransEl *data = st->outRange.data;
+	if ( !keyOps->isSigned ) {
+		CHAR_CLASS_SEARCH( st );
+		return;
+	}
+
+	bool allSingles = true;
+	for ( int r = 0; r < numRanges; r++ ) {
+		if ( !keyOps->eq( data[r].lowKey, data[r].highKey ) )
+			allSingles = false;
+	}
+
+	long long low = data[0].lowKey.getVal();
+	long long span = keyOps->span( data[0].lowKey, data[numRanges-1].highKey );
+
+	if ( numRanges <= 4 ) {
+		out <<
+			"	movzbl	(" << P() << "), %r10d\n";
+		emitRangeBSearch( st, 0, numRanges - 1 );
+	}
+	else if ( allSingles && low >= 0 && span <= 4 * numRanges ) {
+		out <<
+			"	movzbl	(" << P() << "), %r10d\n";
+
+		/* The singles list is otherwise unused by this backend. */
+		st->outSingle.append( data, numRanges );
+		emitSingleJumpTable( st, CLABEL( "nf", st->id ) );
+		st->outSingle.empty();
+	}
+	else {
+		CHAR_CLASS_SEARCH( st );
+	}
+}
+
+/* States that can run without checking for the end of the buffer, once it is
+ * known that enough input remains. Anything that looks at eof, runs state
+ * actions or pushes NFA alternatives stays on the checked path. */
+bool AsmCodeGen::unrollState( RedStateAp *st )
+{
+	return unroll > 0 && !noEnd && st != redFsm->errState &&
+			!redFsm->anyEofActivity() && !redFsm->anyNfaStates() &&
+			st->toStateAction == 0 && st->fromStateAction == 0;
+}
+
+/* Copies of the unrollable states for a block of unroll characters. Copy k
+ * reads p + k, so no copy compares p with pe. Action-free transitions between
+ * unrollable states go to the next copy, and the last copy leaves for the
+ * checked states, which enter the block again if enough input remains. */
+void AsmCodeGen::UNROLLED_STATES()
+{
+	for ( unrollCopy = 0; unrollCopy < unroll; unrollCopy++ ) {
+		for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+			if ( !unrollState( st ) )
+				continue;
+
+			if ( unrollCopy == 0 )
+				out << CLABEL( "en", st->id ) << ":\n";
+			else {
+				out <<
+					CLABEL( "st", st->id ) << ":\n"
+					"	addq	$1, " << P() << "\n";
+			}
+
+			if ( st->anyRegCurStateRef() ) {
+				out <<
+					"	movq	$" << st->id << ", " << PS() << "\n";
+			}
+
+			UNROLLED_SEARCH( st );
+
+			out << CLABEL( "nf", st->id ) << ":\n";
+			TRANS_GOTO( st->defTrans );
+		}
+	}
+
+	unrollCopy = -1;
+}
+
 void AsmCodeGen::STATE_GOTOS()
 {
 	bool eof = redFsm->anyEofActivity() || redFsm->anyNfaStates();
@@ -1229,6 +1371,14 @@ void AsmCodeGen::STATE_GOTOS()
 				}
 			}
 
+			if ( unrollState( st ) ) {
+				out <<
+					"	movq	" << PE() << ", %rax\n"
+					"	subq	" << P() << ", %rax\n"
+					"	cmpq	$" << unroll << ", %rax\n"
+					"	jge		" << UNROLL_LABEL( "en", 0, st->id ) << "\n";
+			}
+
 			NFA_PUSH( st );
 
 			if ( st->fromStateAction != 0 ) {
@@ -1265,7 +1415,7 @@ void AsmCodeGen::STATE_GOTOS()
 			/* Record the prev state if necessary. */
 			if ( st->anyRegCurStateRef() ) {
 				out <<
-					"	movq	$" << st->id << ", -72(%rbp)\n";
+					"	movq	$" << st->id << ", " << PS() << "\n";
 			}
 
 
@@ -1280,34 +1430,8 @@ void AsmCodeGen::STATE_GOTOS()
 #endif
 
 			/* Load *p. */
-			if ( st->transList != 0 ) {
-				long lowKey = redFsm->lowKey.getVal();
-				long highKey = redFsm->highKey.getVal();
-
-				out <<
-					"	movzbl	(" << P() << "), %r10d\n"
-					"	cmpl	$" << lowKey << ", %r10d\n"
-					"	jl		" << LABEL( "nf", st->id ) << "\n"
-					"	cmpl	$" << highKey << ", %r10d\n"
-					"	jg		" << LABEL( "nf", st->id ) << "\n"
-					"	subl	" << KEY( lowKey ) << ", %r10d\n"
-					"	leaq	" << LABEL( "char_class" ) << "(%rip), %rcx\n"
-					"	movslq	%r10d, %rax\n"
-					"	movb	(%rcx, %rax), %r10b\n"
-				;
-
-
-				long len = ( st->high - st->low + 1 );
-
-				if ( len < 8 )
-					emitCharClassIfElseIf( st );
-				else {
-					string def;
-					if ( st->outRange.length() == 0 )
-						def = TRANS_GOTO_TARG( st->defTrans );
-					emitCharClassJumpTable( st, def );
-				}
-			}
+			if ( st->transList != 0 )
+				CHAR_CLASS_SEARCH( st );
 
 			/* Write the default transition. */
 			out << LABEL( "nf", st->id ) << ":\n";
@@ -1318,6 +1442,9 @@ void AsmCodeGen::STATE_GOTOS()
 			}
 		}
 	}
+
+	if ( unroll > 0 )
+		UNROLLED_STATES();
 }
 
 unsigned int AsmCodeGen::TO_STATE_ACTION( RedStateAp *state )
@@ -1489,7 +1616,7 @@ void AsmCodeGen::NRET( ostream &ret, bool inFinish )
 void AsmCodeGen::CURS( ostream &ret, bool inFinish )
 {
 	ret <<
-		"	movq	-72(%rbp), %rax\n";
+		"	movq	" << PS() << ", %rax\n";
 }
 
 void AsmCodeGen::TARGS( ostream &ret, bool inFinish, int targState )
@@ -1507,6 +1634,42 @@ void AsmCodeGen::BREAK( ostream &ret, int targState, bool csForced )
 	ret << CTRL_FLOW() << "goto _out;}";
 }
 
+/* Branch on the conditions that decide between the targets, as picked by
+ * RedTransAp::condSplit. Keys with no pair and no error pair leave through the
+ * cte label, where the search would have fallen through. */
+void AsmCodeGen::COND_TREE( RedTransAp *trans, RedCondPair **outcomes, long mask, long val )
+{
+	static int nct = 1;
+
+	int pos = trans->condSplit( outcomes, mask, val );
+	if ( pos < 0 ) {
+		long k = 0;
+		while ( ( k & mask ) != val )
+			k++;
+
+		if ( outcomes[k] != 0 )
+			out << "	jmp		" << TRANS_GOTO_TARG( outcomes[k] ) << "\n";
+		else
+			out << "	jmp		" << LABEL( "cte", trans->id ) << "\n";
+		return;
+	}
+
+	long bit = 1 << pos;
+	int f = nct++;
+
+	CONDITION( out, trans->condSpace->condSet.data[pos] );
+	out <<
+		"\n"
+		"	test	%eax, %eax\n"
+		"	je		" << LABEL( "ctf", f ) << "\n";
+
+	COND_TREE( trans, outcomes, mask | bit, val | bit );
+
+	out << LABEL( "ctf", f ) << ":\n";
+
+	COND_TREE( trans, outcomes, mask | bit, val );
+}
+
 bool AsmCodeGen::IN_TRANS_ACTIONS( RedStateAp *state )
 {
 	bool anyWritten = false;
@@ -1545,6 +1708,14 @@ bool AsmCodeGen::IN_TRANS_ACTIONS( RedStateAp *state )
 				"	je		" << TRANS_GOTO_TARG( fp ) << "\n"
 				"	jmp		" << TRANS_GOTO_TARG( tp ) << "\n";
 		}
+		else if ( trans->condTree() ) {
+			RedCondPair **outcomes = new RedCondPair*[trans->condFullSize()];
+			trans->condOutcomes( outcomes );
+			COND_TREE( trans, outcomes, 0, 0 );
+			delete[] outcomes;
+
+			out << LABEL( "cte", trans->id ) << ":\n";
+		}
 		else {
 			out << "	movq	$0, %r9\n";
 
@@ -1633,7 +1804,14 @@ bool AsmCodeGen::IN_TRANS_ACTIONS( RedStateAp *state )
 std::string AsmCodeGen::TRANS_GOTO_TARG( RedCondPair *pair )
 {
 	std::stringstream s;
-	if ( pair->action != 0 ) {
+	if ( unrollCopy >= 0 && pair->action == 0 && unrollState( pair->targ ) ) {
+		/* Stay in the block while it lasts. */
+		if ( unrollCopy + 1 < unroll )
+			s << UNROLL_LABEL( "st", unrollCopy + 1, pair->targ->id );
+		else
+			s << LABEL( "st", pair->targ->id );
+	}
+	else if ( pair->action != 0 ) {
 		/* Go to the transition which will go to the state. */
 		s << LABEL( "tr", pair->id );
 	}
@@ -1841,7 +2019,7 @@ void AsmCodeGen::writeData()
 
 	for ( long long pos = 0; pos < maxSpan; pos++ ) {
 		out <<
-			"	.byte " << redFsm->classMap[pos] << "\n";
+			"	.byte " << redFsm->classAt( pos ) << "\n";
 	}
 	
 #ifdef LOG_TRANS
@@ -1910,16 +2088,23 @@ void AsmCodeGen::writeExec()
 	 * stack:     -56(%rbp)
 	 * top:       -64(%rbp)
 	 *
-	 * _ps:       -72(%rbp)
+	 * _ps:       -72(%rbp), or %rbx with --asm-unroll, saved on entry
 	 *
 	 * nfa_stack  -80(%rbp)
 	 * nfa_top    -88(%rbp)
 	 * nfa_sz     -96(%rbp)
 	 */
 
+	if ( unroll > 0 ) {
+		/* Keeps the stack 16-byte aligned for calls in actions. */
+		out <<
+			"	pushq	%rbx\n"
+			"	subq	$8, %rsp\n";
+	}
+
 	if ( redFsm->anyRegCurStateRef() ) {
 		out <<
-			"	movq	$0, -72(%rbp)\n";
+			"	movq	$0, " << PS() << "\n";
 	}
 
 	if ( stackCS ) {
@@ -2025,6 +2210,12 @@ void AsmCodeGen::writeExec()
 
 	out << LABEL( "out" ) << ":\n";
 
+	if ( unroll > 0 ) {
+		out <<
+			"	addq	$8, %rsp\n"
+			"	popq	%rbx\n";
+	}
+
 	if ( stackCS ) {
 		out <<
 			"	movq	" << vCS() << ", %r11\n";
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "binary.h"
+#include "redfsm.h"
+#include "gendata.h"
+
+/*
+ * Eytzinger layout of the binary tables. Each state's single keys and range
+ * pairs are stored in breadth-first order of the implicit search tree, along
+ * with their indices, so the search descends without a data dependent branch.
+ * States with few keys keep the sorted order and are searched with a counting
+ * loop, which compilers vectorize. Only when writing C directly.
+ */
+
+static const int linearKeys = 16;
+
+/* Fill perm with the sorted position of the item stored at each slot of the
+ * Eytzinger layout. Slots are numbered from one, as in the search. */
+static int eytzingerOrder( int *perm, int n, int pos, int k )
+{
+	if ( k <= n ) {
+		pos = eytzingerOrder( perm, n, pos, 2 * k );
+		perm[k - 1] = pos++;
+		pos = eytzingerOrder( perm, n, pos, 2 * k + 1 );
+	}
+	return pos;
+}
+
+static int *keyOrder( int n )
+{
+	int *perm = new int[n];
+	if ( n <= linearKeys ) {
+		for ( int i = 0; i < n; i++ )
+			perm[i] = i;
+	}
+	else {
+		eytzingerOrder( perm, n, 0, 1 );
+	}
+	return perm;
+}
+
+bool Binary::eytzingerSearch()
+{
+	return backend == Direct && red->id->eytzingerSearch;
+}
+
+void Binary::taKeysEytz()
+{
+	transKeys.start();
+
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		int numSingles = st->outSingle.length();
+		int *perm = keyOrder( numSingles );
+		for ( int i = 0; i < numSingles; i++ )
+			transKeys.value( st->outSingle[perm[i]].lowKey.getVal() );
+		delete[] perm;
+
+		int numRanges = st->outRange.length();
+		perm = keyOrder( numRanges );
+		for ( int i = 0; i < numRanges; i++ ) {
+			RedTransEl &rtel = st->outRange[perm[i]];
+
+			/* Lower key. */
+			transKeys.value( rtel.lowKey.getVal() );
+
+			/* Upper key. */
+			transKeys.value( rtel.highKey.getVal() );
+		}
+		delete[] perm;
+	}
+
+	transKeys.finish();
+}
+
+void Binary::taIndicesEytz()
+{
+	indices.start();
+
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		/* Walk the singles, in the order of their keys. */
+		int numSingles = st->outSingle.length();
+		int *perm = keyOrder( numSingles );
+		for ( int i = 0; i < numSingles; i++ )
+			indices.value( st->outSingle[perm[i]].value->id );
+		delete[] perm;
+
+		/* Walk the ranges. */
+		int numRanges = st->outRange.length();
+		perm = keyOrder( numRanges );
+		for ( int i = 0; i < numRanges; i++ )
+			indices.value( st->outRange[perm[i]].value->id );
+		delete[] perm;
+
+		/* The state's default index goes next. */
+		if ( st->defTrans != 0 )
+			indices.value( st->defTrans->id );
+	}
+
+	indices.finish();
+}
+
+void Binary::LOCATE_TRANS_EYTZ()
+{
+	out <<
+		"	" << keys << " = " << OFFSET( ARR_REF( transKeys ), ARR_REF( keyOffsets ) + "[" + vCS() + "]" ) << ";\n"
+		"	" << trans << " = " << CAST(UINT()) << ARR_REF( indexOffsets ) << "[" << vCS() << "];\n"
+		"\n"
+		"	{\n"
+		"	" << ALPH_TYPE() << " _c = " << GET_KEY() << ";\n"
+		"	int _k, _n;\n"
+		"\n"
+		"	" << klen << " = " << CAST( "int" ) << ARR_REF( singleLens ) << "[" << vCS() << "];\n"
+		"	if ( " << klen << " > 0 ) {\n"
+		"		if ( " << klen << " <= " << linearKeys << " ) {\n"
+		"			_n = 0;\n"
+		"			for ( _k = 0; _k < " << klen << "; _k++ )\n"
+		"				_n += " << keys << "[_k] < _c;\n"
+		"		}\n"
+		"		else {\n"
+		"			_k = 1;\n"
+		"			while ( _k <= " << klen << " )\n"
+		"				_k = 2 * _k + ( " << keys << "[_k - 1] < _c );\n"
+		"			while ( _k & 1 )\n"
+		"				_k >>= 1;\n"
+		"			_k >>= 1;\n"
+		"			_n = _k == 0 ? " << klen << " : _k - 1;\n"
+		"		}\n"
+		"\n"
+		"		if ( _n < " << klen << " && " << keys << "[_n] == _c ) {\n"
+		"			" << trans << " += " << CAST( UINT() ) << "_n;\n"
+		"			goto " << _match << ";\n"
+		"		}\n"
+		"\n"
+		"		" << keys << " += " << klen << ";\n"
+		"		" << trans << " += " << CAST( UINT() ) << klen << ";\n"
+		"	}\n"
+		"\n"
+		"	" << klen << " = " << CAST( "int" ) << ARR_REF( rangeLens ) << "[" << vCS() << "];\n"
+		"	if ( " << klen << " > 0 ) {\n"
+		"		if ( " << klen << " <= " << linearKeys << " ) {\n"
+		"			_n = 0;\n"
+		"			for ( _k = 0; _k < " << klen << "; _k++ )\n"
+		"				_n += " << keys << "[2 * _k + 1] < _c;\n"
+		"		}\n"
+		"		else {\n"
+		"			_k = 1;\n"
+		"			while ( _k <= " << klen << " )\n"
+		"				_k = 2 * _k + ( " << keys << "[2 * _k - 1] < _c );\n"
+		"			while ( _k & 1 )\n"
+		"				_k >>= 1;\n"
+		"			_k >>= 1;\n"
+		"			_n = _k == 0 ? " << klen << " : _k - 1;\n"
+		"		}\n"
+		"\n"
+		"		if ( _n < " << klen << " && " << keys << "[2 * _n] <= _c ) {\n"
+		"			" << trans << " += " << CAST( UINT() ) << "_n;\n"
+		"			goto " << _match << ";\n"
+		"		}\n"
+		"\n"
+		"		" << trans << " += " << CAST( UINT() ) << klen << ";\n"
+		"	}\n"
+		"	}\n"
+		"\n";
+
+	out << EMIT_LABEL( _match );
+}
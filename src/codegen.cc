@@ -26,9 +26,11 @@
 #include "gendata.h"
 #include "inputdata.h"
 #include "parsedata.h"
+#include "tablepool.h"
 #include <sstream>
 #include <string>
 #include <assert.h>
+#include <string.h>
 #include <iomanip>
 
 
@@ -57,6 +59,57 @@ std::ostream &operator<<( std::ostream &out, GotoLabel &l )
 	return out;
 }
 
+TablePool::~TablePool()
+{
+	while ( head != 0 ) {
+		SharedTable *next = head->next;
+		delete head;
+		head = next;
+	}
+}
+
+static unsigned long tableHash( const std::string &type, const Vector<long long> &values )
+{
+	/* FNV-1a over the type name and the values. */
+	unsigned long h = 2166136261ul;
+	for ( std::string::const_iterator c = type.begin(); c != type.end(); c++ )
+		h = ( h ^ (unsigned char)*c ) * 16777619ul;
+	for ( long i = 0; i < values.length(); i++ ) {
+		unsigned long long v = values[i];
+		for ( int b = 0; b < 8; b++, v >>= 8 )
+			h = ( h ^ ( v & 0xff ) ) * 16777619ul;
+	}
+	return h;
+}
+
+SharedTable *TablePool::find( const std::string &type, bool isChar, bool isSigned,
+		const Vector<long long> &values )
+{
+	unsigned long hash = tableHash( type, values );
+	for ( SharedTable *st = head; st != 0; st = st->next ) {
+		if ( st->hash == hash && st->type == type && st->isChar == isChar &&
+				st->isSigned == isSigned && st->values.length() == values.length() &&
+				( values.length() == 0 || memcmp( st->values.data, values.data,
+						sizeof(long long) * values.length() ) == 0 ) )
+			return st;
+	}
+	return 0;
+}
+
+void TablePool::insert( const std::string &type, bool isChar, bool isSigned,
+		const Vector<long long> &values, const std::string &addr )
+{
+	SharedTable *st = new SharedTable;
+	st->hash = tableHash( type, values );
+	st->type = type;
+	st->isChar = isChar;
+	st->isSigned = isSigned;
+	st->values = values;
+	st->addr = addr;
+	st->next = head;
+	head = st;
+}
+
 TableArray::TableArray( const char *name, CodeGen &codeGen )
 :
 	state(InitialState),
@@ -65,8 +118,12 @@ TableArray::TableArray( const char *name, CodeGen &codeGen )
 	isSigned(true),
 	isChar(false),
 	stringTables( codeGen.stringTables ),
+	blobTables( codeGen.blobTables ),
+	shareTables( codeGen.shareTables ),
 	iall( codeGen.stringTables ? IALL_STRING : IALL_INTEGRAL ),
 	values(0),
+	blobOffset(0),
+	aliased(false),
 
 	/*
 	 * Use zero for min and max because 
@@ -102,6 +159,8 @@ void TableArray::startAnalyze()
 void TableArray::valueAnalyze( long long v )
 {
 	values += 1;
+	if ( shareTables )
+		content.append( v );
 	if ( v < min )
 		min = v;
 	if ( v > max )
@@ -162,10 +221,47 @@ void TableArray::finishAnalyze()
 	}
 }
 
+/* With --share-tables, point at an identical table written by an earlier
+ * machine, or offer this one to later machines. */
+bool TableArray::shareGenerate()
+{
+	TablePool &pool = codeGen.red->id->tablePool;
+	std::string ident = string("_") + codeGen.DATA_PREFIX() + name;
+
+	SharedTable *shared = pool.find( type, isChar, isSigned, content );
+	if ( shared != 0 ) {
+		out << "static const " << type << " *const " << ident <<
+				" = " << shared->addr << ";\n\n";
+		return true;
+	}
+
+	/* String tables are reached through a pointer variable, which is not a
+	 * constant, so share the string itself. */
+	std::string addr = ident;
+	if ( stringTables && !blobTables )
+		addr = string("(const ") + type + "*) S_" + codeGen.DATA_PREFIX() + name;
+
+	pool.insert( type, isChar, isSigned, content, addr );
+	return false;
+}
+
 void TableArray::startGenerate()
 {
+	if ( shareTables ) {
+		aliased = shareGenerate();
+		if ( aliased )
+			return;
+	}
+
 	if ( codeGen.backend == Direct ) {
-		if ( stringTables ) {
+		if ( blobTables ) {
+			/* Start each table on a sixteen byte boundary. */
+			std::string &blob = codeGen.red->id->blobData;
+			while ( blob.length() % 16 != 0 )
+				blob += '\0';
+			blobOffset = blob.length();
+		}
+		else if ( stringTables ) {
 			out << "static const char S_" << codeGen.DATA_PREFIX() << name <<
 				"[] __attribute__((aligned (16))) = \n\t\"";
 		}
@@ -230,10 +326,68 @@ void TableArray::stringGenerate( long long value )
 	out.fill( prevFill );
 }
 
+/* Append the value to the table blob, least significant byte first. */
+void TableArray::blobGenerate( long long value )
+{
+	std::string &blob = codeGen.red->id->blobData;
+	unsigned long long u = value;
+	for ( int n = 0; n < width; n++ ) {
+		blob += (char)( u & 0xff );
+		u >>= 8;
+	}
+}
+
+/* Reference the table's bytes in the blob from an assembler stub. The blob
+ * is written next to the output file and pulled in with .incbin by its base
+ * name, so the output does not depend on where ragel ran. The assembler finds
+ * it through -I. */
+void TableArray::blobFinish()
+{
+	std::string &blob = codeGen.red->id->blobData;
+	std::string sym = string("_") + codeGen.DATA_PREFIX() + name + "_blob";
+
+	const char *baseName = strrchr( codeGen.red->id->blobFileName, '/' );
+	baseName = baseName != 0 ? baseName + 1 : codeGen.red->id->blobFileName;
+
+	std::string fileName;
+	for ( const char *pc = baseName; *pc != 0; pc++ ) {
+		if ( *pc == '\\' )
+			fileName += "\\\\\\\\";
+		else if ( *pc == '"' )
+			fileName += "\\\\\\\"";
+		else
+			fileName += *pc;
+	}
+
+	/* The first table in the output checks the byte order once. */
+	if ( blobOffset == 0 ) {
+		out <<
+			"#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__\n"
+			"#error \"ragel table blobs are little-endian\"\n"
+			"#endif\n"
+			"\n";
+	}
+
+	out <<
+		"__asm__(\n"
+		"	\"\\t.section .rodata\\n\"\n"
+		"	\"\\t.balign 16\\n\"\n"
+		"	\"" << sym << ":\\n\"\n"
+		"	\"\\t.incbin \\\"" << fileName << "\\\", " << blobOffset << ", " <<
+				( blob.length() - blobOffset ) << "\\n\"\n"
+		"	\"\\t.previous\\n\"\n"
+		");\n"
+		"extern const " << type << " _" << codeGen.DATA_PREFIX() << name <<
+				"[] __asm__( \"" << sym << "\" ) __attribute__((visibility(\"hidden\")));\n\n";
+}
+
 void TableArray::valueGenerate( long long v )
 {
 	if ( codeGen.backend == Direct ) {
-		if ( stringTables ) {
+		if ( blobTables ) {
+			blobGenerate( v );
+		}
+		else if ( stringTables ) {
 			stringGenerate( v );
 
 			if ( ++ln % iall == 0 ) {
@@ -271,8 +425,21 @@ void TableArray::valueGenerate( long long v )
 
 void TableArray::finishGenerate()
 {
+	if ( aliased ) {
+		if ( codeGen.red->id->printStatistics ) {
+			codeGen.red->id->stats() << name << "\t" << values << "\t" <<
+				0 << "\t" << endl;
+		}
+		return;
+	}
+
 	if ( codeGen.backend == Direct ) {
-		if ( stringTables ) {
+		if ( blobTables ) {
+			/* Null terminated, as with the other forms. */
+			blobGenerate( 0 );
+			blobFinish();
+		}
+		else if ( stringTables ) {
 	        out << "\";\nconst " << type << " *_" << codeGen.DATA_PREFIX() << name <<
 	                " = (const " << type << "*) S_" << codeGen.DATA_PREFIX() << name << ";\n\n";
 
@@ -330,7 +497,7 @@ void TableArray::value( long long v )
 			valueAnalyze( v );
 			break;
 		case GeneratePass:
-			if ( isReferenced )
+			if ( isReferenced && !aliased )
 				valueGenerate( v );
 			break;
 	}
@@ -364,6 +531,9 @@ CodeGen::CodeGen( const CodeGenArgs &args )
 	tableData( 0 ),
 	backend( args.id->hostLang->backend ),
 	stringTables( args.id->stringTables ),
+	blobTables( args.id->blobTables && backend == Direct ),
+	shareTables( args.id->shareTables && backend == Direct ),
+	stateStruct( false ),
 
 	nfaTargs(         "nfa_targs",           *this ),
 	nfaOffsets(       "nfa_offsets",         *this ),
@@ -454,6 +624,19 @@ string CodeGen::vEOF()
 	return ret.str();
 }
 
+string CodeGen::vDATA()
+{
+	ostringstream ret;
+	if ( red->dataExpr == 0 )
+		ret << "data";
+	else {
+		ret << OPEN_HOST_EXPR();
+		INLINE_LIST( ret, red->dataExpr, 0, false, false );
+		ret << CLOSE_HOST_EXPR();
+	}
+	return ret.str();
+}
+
 string CodeGen::vCS()
 {
 	ostringstream ret;
@@ -510,7 +693,9 @@ string CodeGen::ACT()
 string CodeGen::TOKSTART()
 {
 	ostringstream ret;
-	if ( red->tokstartExpr == 0 )
+	if ( stateStruct )
+		ret << "ts";
+	else if ( red->tokstartExpr == 0 )
 		ret << ACCESS() + "ts";
 	else {
 		ret << OPEN_HOST_EXPR();
@@ -523,7 +708,9 @@ string CodeGen::TOKSTART()
 string CodeGen::TOKEND()
 {
 	ostringstream ret;
-	if ( red->tokendExpr == 0 )
+	if ( stateStruct )
+		ret << "te";
+	else if ( red->tokendExpr == 0 )
 		ret << ACCESS() + "te";
 	else {
 		ret << OPEN_HOST_EXPR();
@@ -542,6 +729,10 @@ string CodeGen::GET_KEY()
 		INLINE_LIST( ret, red->getKeyExpr, 0, false, false );
 		ret << CLOSE_HOST_EXPR();
 	}
+	else if ( red->id->utf8Input ) {
+		/* The codepoint decoded at the top of the loop. */
+		ret << "_uc";
+	}
 	else {
 		/* Expression for retrieving the key, use simple dereference. */
 		ret << "( " << DEREF( "data", P() ) << ")";
@@ -664,6 +855,29 @@ void CodeGen::SET_TOKSTART( ostream &ret, GenInlineItem *item )
 	ret << TOKSTART() << " = " << P() << ";";
 }
 
+/* A token start is where checkpoints are taken and where a rescan stops once
+ * it meets the old records. Stopping is fhold; fbreak;, leaving p on the
+ * token start. */
+void CodeGen::CKPT( ostream &ret, int targState )
+{
+	ret << " if ( " << DATA_PREFIX() << "ckpt_take( &" << ACCESS() << "ckpts, " <<
+			P() << " - " << vDATA() << ", ";
+	TARGS( ret, false, targState );
+	ret << " ) ) { " << P() << " -= 1; ";
+	BREAK( ret, targState, false );
+	ret << " }";
+}
+
+/* Before p moves back, note how far the scan has read. A record is good to
+ * resume from only if nothing read before it was changed. */
+void CodeGen::CKPT_FAR( ostream &ret )
+{
+	if ( red->hasLongestMatch && red->id->checkpoints > 0 ) {
+		ret << "if ( " << P() << " - " << vDATA() << " > " << ACCESS() << "ckpts.far ) " <<
+				ACCESS() << "ckpts.far = " << P() << " - " << vDATA() << "; ";
+	}
+}
+
 void CodeGen::HOST_STMT( ostream &ret, GenInlineItem *item, 
 		int targState, bool inFinish, bool csForced )
 {
@@ -787,15 +1001,18 @@ void CodeGen::INLINE_LIST( ostream &ret, GenInlineList *inlineList,
 			ret << OPEN_GEN_EXPR() << GET_KEY() << CLOSE_GEN_EXPR();
 			break;
 		case GenInlineItem::Hold:
-			ret << OPEN_GEN_BLOCK() << P() << " = " << P() << " - 1; " << CLOSE_GEN_BLOCK();
+			CKPT_FAR( ret );
+			ret << OPEN_GEN_BLOCK() << P() << " = " << P() << " - 1" << UTF8_HOLD() << "; " << CLOSE_GEN_BLOCK();
 			break;
 		case GenInlineItem::LmHold:
-			ret << P() << " = " << P() << " - 1;";
+			CKPT_FAR( ret );
+			ret << P() << " = " << P() << " - 1" << UTF8_HOLD() << ";";
 			break;
 		case GenInlineItem::NfaClear:
 			ret << "nfa_len = 0; ";
 			break;
 		case GenInlineItem::Exec:
+			CKPT_FAR( ret );
 			EXEC( ret, item, targState, inFinish );
 			break;
 		case GenInlineItem::Curs:
@@ -823,6 +1040,7 @@ void CodeGen::INLINE_LIST( ostream &ret, GenInlineList *inlineList,
 			LM_SWITCH( ret, item, targState, inFinish, csForced );
 			break;
 		case GenInlineItem::LmExec:
+			CKPT_FAR( ret );
 			LM_EXEC( ret, item, targState, inFinish );
 			break;
 		case GenInlineItem::LmCase:
@@ -845,6 +1063,8 @@ void CodeGen::INLINE_LIST( ostream &ret, GenInlineList *inlineList,
 			break;
 		case GenInlineItem::LmSetTokStart:
 			SET_TOKSTART( ret, item );
+			if ( red->id->checkpoints > 0 )
+				CKPT( ret, targState );
 			break;
 		case GenInlineItem::Break:
 			BREAK( ret, targState, csForced );
@@ -1030,7 +1250,29 @@ void CodeGen::writeInit()
 		out << "\t" << TOP() << " = 0;\n";
 	}
 
-	if ( red->hasLongestMatch ) {
+	if ( red->hasLongestMatch && red->id->checkpoints > 0 ) {
+		out <<
+			"	" << ACCESS() << "ckpts.len = 0;\n"
+			"	" << ACCESS() << "ckpts.next = 0;\n"
+			"	" << ACCESS() << "ckpts.far = 0;\n"
+			"	" << ACCESS() << "ckpts.old = 0;\n"
+			"	" << ACCESS() << "ckpts.old_len = 0;\n"
+			"	" << ACCESS() << "ckpts.old_pos = 0;\n"
+			"	" << ACCESS() << "ckpts.delta = 0;\n"
+			"	" << ACCESS() << "ckpts.converged = 0;\n";
+	}
+
+	if ( red->hasLongestMatch && stateStruct ) {
+		out <<
+			"	" << ACCESS() << "ts = 0;\n"
+			"	" << ACCESS() << "te = 0;\n";
+
+		if ( redFsm->usingAct() ) {
+			out << 
+				"	" << ACT() << " = 0;\n";
+		}
+	}
+	else if ( red->hasLongestMatch ) {
 		out << 
 			"	" << TOKSTART() << " = " << NIL() << ";\n"
 			"	" << TOKEND() << " = " << NIL() << ";\n";
@@ -1087,6 +1329,9 @@ void CodeGen::STATE_IDS()
 	if ( !noError )
 		VALUE( "int", ERROR(), ERROR_STATE() );
 
+	if ( redFsm->bNfaMemo )
+		VALUE( "int", DATA_PREFIX() + "nfa_memo_width", STR( redFsm->nextStateId ) );
+
 	out << "\n";
 
 	if ( red->entryPointNames.length() > 0 ) {
@@ -1096,6 +1341,353 @@ void CodeGen::STATE_IDS()
 		}
 		out << "\n";
 	}
+
+	if ( red->id->matchIds )
+		MATCH_IDS();
+
+	/* Exact sizes for the call and NFA stacks, where they are bounded. */
+	bool calls = redFsm->anyActionCalls() || redFsm->anyActionNcalls();
+	if ( ( calls && redFsm->maxStack >= 0 ) ||
+			( redFsm->anyNfaStates() && redFsm->maxNfaStack >= 0 ) )
+	{
+		if ( calls && redFsm->maxStack >= 0 )
+			VALUE( "int", DATA_PREFIX() + "max_stack", STR( redFsm->maxStack ) );
+		if ( redFsm->anyNfaStates() && redFsm->maxNfaStack >= 0 )
+			VALUE( "int", DATA_PREFIX() + "max_nfa_stack", STR( redFsm->maxNfaStack ) );
+		out << "\n";
+	}
+
+	/* Length of the reps array the counter loops use. */
+	if ( red->fsmCtx->nextCounterRep > 0 ) {
+		VALUE( "int", DATA_PREFIX() + "num_reps", STR( red->fsmCtx->nextCounterRep ) );
+		out << "\n";
+	}
+
+	if ( red->hasLongestMatch && red->id->checkpoints > 0 )
+		CKPT_DATA();
+}
+
+/* Checkpoint records and the two helpers exec and the host use. A record is
+ * the offset of a token start, the furthest offset read before it and the
+ * state there. Records are at least checkpoints bytes apart. A rescan resumes
+ * from a record whose reads all came before the edit and stops at the first
+ * token start that matches an old record after it. */
+void CodeGen::CKPT_DATA()
+{
+	if ( redFsm->anyActionCalls() || redFsm->anyActionNcalls() ||
+			redFsm->anyActionRets() || redFsm->anyActionNrets() )
+	{
+		red->id->error() << "--checkpoints cannot be used with a scanner "
+				"that calls, the records do not hold the stack" << endl;
+		return;
+	}
+
+	if ( redFsm->anyNfaStates() ) {
+		red->id->error() << "--checkpoints is not supported for NFA machines" << endl;
+		return;
+	}
+
+	string prefix = DATA_PREFIX();
+
+	out <<
+		"struct " << prefix << "ckpt_rec\n"
+		"{\n"
+		"	long off;\n"
+		"	long la;\n"
+		"	int cs;\n"
+		"};\n"
+		"\n"
+		"struct " << prefix << "ckpts\n"
+		"{\n"
+		"	struct " << prefix << "ckpt_rec *rec;\n"
+		"	long len, max, next, far;\n"
+		"	const struct " << prefix << "ckpt_rec *old;\n"
+		"	long old_len, old_pos, delta;\n"
+		"	int converged;\n"
+		"};\n"
+		"\n";
+
+	/* Called at every token start. Old offsets are shifted by delta into the
+	 * new text. */
+	out <<
+		"static int " << prefix << "ckpt_take( struct " << prefix << "ckpts *ck, long off, int cs )\n"
+		"{\n"
+		"	while ( ck->old_pos < ck->old_len && ck->old[ck->old_pos].off + ck->delta < off )\n"
+		"		ck->old_pos += 1;\n"
+		"	if ( ck->old_pos < ck->old_len && ck->old[ck->old_pos].off + ck->delta == off &&\n"
+		"			ck->old[ck->old_pos].cs == cs ) {\n"
+		"		ck->converged = 1;\n"
+		"		return 1;\n"
+		"	}\n"
+		"	if ( off >= ck->next && ck->len < ck->max ) {\n"
+		"		ck->rec[ck->len].off = off;\n"
+		"		ck->rec[ck->len].la = ck->far > off ? ck->far : off;\n"
+		"		ck->rec[ck->len].cs = cs;\n"
+		"		ck->len += 1;\n"
+		"		ck->next = off + " << red->id->checkpoints << ";\n"
+		"	}\n"
+		"	return 0;\n"
+		"}\n"
+		"\n";
+
+	/* Bytes [a, b) of the old text were replaced by n bytes. Resume from the
+	 * last record whose scan read nothing from a on. The la fields never
+	 * decrease, so a search finds it. Records from b on are where the rescan
+	 * can stop. */
+	out <<
+		"static long " << prefix << "ckpt_resume( struct " << prefix << "ckpts *ck,\n"
+		"		const struct " << prefix << "ckpt_rec *old, long old_len, long a, long b, long n )\n"
+		"{\n"
+		"	long lo = 0, hi = old_len, mid, i;\n"
+		"	while ( lo < hi ) {\n"
+		"		mid = ( lo + hi ) / 2;\n"
+		"		if ( old[mid].la < a )\n"
+		"			lo = mid + 1;\n"
+		"		else\n"
+		"			hi = mid;\n"
+		"	}\n"
+		"	i = lo - 1;\n"
+		"	hi = old_len;\n"
+		"	while ( lo < hi ) {\n"
+		"		mid = ( lo + hi ) / 2;\n"
+		"		if ( old[mid].off < b )\n"
+		"			lo = mid + 1;\n"
+		"		else\n"
+		"			hi = mid;\n"
+		"	}\n"
+		"	ck->len = 0;\n"
+		"	ck->next = i >= 0 ? old[i].off : 0;\n"
+		"	ck->far = i >= 0 ? old[i].la : 0;\n"
+		"	ck->old = old;\n"
+		"	ck->old_len = old_len;\n"
+		"	ck->old_pos = lo;\n"
+		"	ck->delta = n - ( b - a );\n"
+		"	ck->converged = 0;\n"
+		"	return i;\n"
+		"}\n"
+		"\n";
+}
+
+/* Smallest unsigned type that holds max. */
+const char *fittingType( long max )
+{
+	if ( max < 256 )
+		return "unsigned char";
+	if ( max < 65536 )
+		return "unsigned short";
+	return "int";
+}
+
+/* The pattern numbers each state accepts. The numbers of state s are at
+ * match_ids[match_offsets[s]] up to match_ids[match_offsets[s+1]]. */
+void CodeGen::MATCH_IDS()
+{
+	RedStateAp **byId = new RedStateAp*[redFsm->nextStateId];
+	memset( byId, 0, sizeof(RedStateAp*) * redFsm->nextStateId );
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		byId[st->id] = st;
+
+	long total = 0, maxId = 0;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		total += st->matchIds.length();
+		for ( int i = 0; i < st->matchIds.length(); i++ ) {
+			if ( st->matchIds[i] > maxId )
+				maxId = st->matchIds[i];
+		}
+	}
+
+	out << "static const " << fittingType( total ) << " " <<
+			DATA_PREFIX() << "match_offsets[] = {";
+	long offset = 0;
+	for ( int s = 0; s <= redFsm->nextStateId; s++ ) {
+		out << ( s % 16 == 0 ? "\n\t" : " " ) << offset << ",";
+		if ( s < redFsm->nextStateId && byId[s] != 0 )
+			offset += byId[s]->matchIds.length();
+	}
+	out << "\n};\n\n";
+
+	out << "static const " << fittingType( maxId ) << " " <<
+			DATA_PREFIX() << "match_ids[] = {";
+	long n = 0;
+	for ( int s = 0; s < redFsm->nextStateId; s++ ) {
+		for ( int i = 0; byId[s] != 0 && i < byId[s]->matchIds.length(); i++, n++ )
+			out << ( n % 16 == 0 ? "\n\t" : " " ) << byId[s]->matchIds[i] << ",";
+	}
+
+	/* Never empty. */
+	if ( n == 0 )
+		out << "\n\t0,";
+	out << "\n};\n\n";
+
+	if ( red->id->printStatistics )
+		red->id->stats() << "match-id-entries\t" << total << endl;
+
+	delete[] byId;
+}
+
+/* The state kept by one machine between calls to exec, each field as narrow
+ * as the machine allows. Exec reaches it through the access statement. Token
+ * start and end are offsets from data plus one, so zero is still none, and
+ * exec works on pointers made from them. The host must then have data. */
+void CodeGen::writeState( InputLoc &loc, long stackSize )
+{
+	bool calls = redFsm->anyActionCalls() || redFsm->anyActionNcalls() ||
+			redFsm->anyActionRets() || redFsm->anyActionNrets();
+
+	if ( backend != Direct ) {
+		red->id->error(loc) << "write state requires C" << endl;
+		return;
+	}
+
+	if ( red->accessExpr == 0 ) {
+		red->id->error(loc) << "write state requires an access statement" << endl;
+		return;
+	}
+
+	if ( red->csExpr != 0 || red->topExpr != 0 || red->stackExpr != 0 ||
+			red->actExpr != 0 || red->tokstartExpr != 0 || red->tokendExpr != 0 )
+	{
+		red->id->error(loc) << "write state cannot be used with variable "
+				"cs, top, stack, act, ts or te" << endl;
+		return;
+	}
+
+	if ( redFsm->anyNfaStates() ) {
+		red->id->error(loc) << "write state is not supported for NFA machines" << endl;
+		return;
+	}
+
+	/* Only the table and -G2 exec loops turn the token offsets into
+	 * pointers and back. */
+	if ( red->hasLongestMatch && ( red->id->forceVar ||
+			red->id->codeStyle == GenGotoLoop || red->id->codeStyle == GenGotoExp ) )
+	{
+		red->id->error(loc) << "write state for a scanner cannot be used "
+				"with --var-backend, -G0 or -G1" << endl;
+		return;
+	}
+
+	/* Without a depth, use the static bound. */
+	if ( calls && stackSize <= 0 )
+		stackSize = redFsm->maxStack;
+
+	if ( calls && stackSize <= 0 ) {
+		red->id->error(loc) << "write state needs the stack depth when "
+				"the call depth has no static bound" << endl;
+		return;
+	}
+
+	const char *csType = fittingType( redFsm->nextStateId );
+
+	out << "struct " << DATA_PREFIX() << "state\n{\n";
+
+	if ( red->hasLongestMatch ) {
+		out <<
+			"	unsigned int ts;\n"
+			"	unsigned int te;\n";
+	}
+
+	out << "	" << csType << " cs;\n";
+
+	if ( red->hasLongestMatch && redFsm->usingAct() )
+		out << "	" << fittingType( red->maxLmId ) << " act;\n";
+
+	if ( calls ) {
+		out <<
+			"	" << fittingType( stackSize ) << " top;\n"
+			"	" << csType << " stack[" << stackSize << "];\n";
+	}
+
+	out << "};\n\n";
+
+	stateStruct = true;
+}
+
+void CodeGen::STATE_LOAD()
+{
+	if ( stateStruct && red->hasLongestMatch ) {
+		out <<
+			"	const " << ALPH_TYPE() << " *ts = " << ACCESS() << "ts != 0 ? " <<
+					vDATA() << " + " << ACCESS() << "ts - 1 : 0;\n"
+			"	const " << ALPH_TYPE() << " *te = " << ACCESS() << "te != 0 ? " <<
+					vDATA() << " + " << ACCESS() << "te - 1 : 0;\n";
+	}
+}
+
+void CodeGen::STATE_STORE()
+{
+	if ( stateStruct && red->hasLongestMatch ) {
+		out <<
+			"	" << ACCESS() << "ts = ts != 0 ? ts - " << vDATA() << " + 1 : 0;\n"
+			"	" << ACCESS() << "te = te != 0 ? te - " << vDATA() << " + 1 : 0;\n";
+	}
+}
+
+/* Bytes that leave the machine in one state whatever state it was in. A
+ * buffer split just after one can be run in pieces, each from that state,
+ * making the same transitions as a run over the whole. */
+void CodeGen::writeSync( InputLoc &loc )
+{
+	if ( backend != Direct ) {
+		red->id->error(loc) << "write sync requires C" << endl;
+		return;
+	}
+
+	/* The search reads the buffer directly. */
+	if ( red->getKeyExpr != 0 ) {
+		red->id->error(loc) << "write sync cannot be used with getkey" << endl;
+		return;
+	}
+
+	long numSync = redFsm->syncAnalysis( red->hasLongestMatch );
+	if ( redFsm->syncTargs.length() == 0 ) {
+		red->id->error(loc) << "write sync requires a one byte alphabet "
+				"and no NFA states" << endl;
+		return;
+	}
+
+	if ( numSync == 0 )
+		red->id->warning(loc) << "no byte synchronizes the machine" << endl;
+
+	string prefix = DATA_PREFIX();
+	string alph = ALPH_TYPE();
+
+	VALUE( "int", prefix + "num_sync", STR( numSync ) );
+
+	/* The state after each byte, by its unsigned value. */
+	out << "static const int " << prefix << "sync_targ[256] = {";
+	for ( int i = 0; i < 256; i++ ) {
+		out << ( i % 16 == 0 ? "\n\t" : " " ) << redFsm->syncTargs[i];
+		if ( i < 255 )
+			out << ",";
+	}
+	out << "\n};\n\n";
+
+	/* Just past the first synchronizing byte in p .. pe, or 0. */
+	out <<
+		"static const " << alph << " *" << prefix << "find_sync( "
+				"const " << alph << " *p, const " << alph << " *pe )\n"
+		"{\n";
+
+	if ( numSync == 1 ) {
+		int b = 0;
+		while ( redFsm->syncTargs[b] < 0 )
+			b++;
+
+		out <<
+			"	p = (const " << alph << "*) memchr( p, " << b << ", pe - p );\n"
+			"	return p != 0 ? p + 1 : 0;\n";
+	}
+	else {
+		out <<
+			"	for ( ; p < pe; p++ ) {\n"
+			"		if ( " << prefix << "sync_targ[(unsigned char)*p] >= 0 )\n"
+			"			return p + 1;\n"
+			"	}\n"
+			"	return 0;\n";
+	}
+
+	out << "}\n\n";
 }
 
 void CodeGen::writeStart()
@@ -1144,6 +1736,10 @@ void CodeGen::NFA_PUSH( std::string state )
 		out <<
 			"		while ( " << alt << " < " << new_recs << " ) { \n";
 
+		if ( redFsm->bNfaMemo ) {
+			NFA_MEMO_TEST( CAST("int") + ARR_REF( nfaTargs ) + "[" + CAST("int") +
+					ARR_REF( nfaOffsets ) + "[" + state + "] + 1 + " + alt.name + "]" );
+		}
 
 		out <<
 			"			nfa_bp[nfa_len].state = " << CAST("int") << ARR_REF( nfaTargs ) << "[" << CAST("int") <<
@@ -1185,7 +1781,12 @@ void CodeGen::NFA_PUSH( std::string state )
 
 
 		out <<
-			"			nfa_len += 1;\n"
+			"			nfa_len += 1;\n";
+
+		if ( redFsm->bNfaMemo )
+			out << "			}}\n";
+
+		out <<
 			"			" << alt << " += 1;\n"
 			"		}\n"
 			"	}\n"
@@ -1193,6 +1794,100 @@ void CodeGen::NFA_PUSH( std::string state )
 	}
 }
 
+/* The NFA visited set has a bit for each state at each position from where
+ * exec was entered. The caller supplies nfa_memo, large enough for
+ * ( pe - p + 1 ) * <prefix>nfa_memo_width bits. */
+void CodeGen::NFA_MEMO_DECLARE()
+{
+	if ( redFsm->bNfaMemo )
+		out << "	const " << ALPH_TYPE() << " *_nfa_mb = " << P() << ";\n";
+}
+
+void CodeGen::NFA_MEMO_INIT()
+{
+	if ( redFsm->bNfaMemo ) {
+		out <<
+			"	memset( nfa_memo, 0, ( (unsigned long)( " << PE() << " - " << P() << " + 1 ) * " <<
+					redFsm->nextStateId << "u + 7u ) / 8u );\n";
+	}
+}
+
+/* Opens two blocks, to be closed after the push, that are skipped if the
+ * state was already pushed at this position. A p from before the p exec was
+ * entered with, restored by an earlier pop, has no bits and always pushes. */
+void CodeGen::NFA_MEMO_TEST( std::string state )
+{
+	out <<
+		"			{ int _nfa_new = 1;\n"
+		"			if ( " << P() << " >= _nfa_mb ) {\n"
+		"				unsigned long _nfa_bit = (unsigned long)( " << P() << " - _nfa_mb ) * " <<
+						redFsm->nextStateId << "u + (unsigned long)" << state << ";\n"
+		"				if ( nfa_memo[_nfa_bit >> 3] & ( 1u << ( _nfa_bit & 7u ) ) )\n"
+		"					_nfa_new = 0;\n"
+		"				else\n"
+		"					nfa_memo[_nfa_bit >> 3] |= (unsigned char)( 1u << ( _nfa_bit & 7u ) );\n"
+		"			}\n"
+		"			if ( _nfa_new ) {\n";
+}
+
+/*
+ * UTF-8 input for codepoint machines. The codepoint is decoded from the bytes
+ * at p and p is moved to the last byte of the sequence, so the usual advance
+ * moves past it. Anything that is not a well formed sequence, including one
+ * cut off by pe, is the key 0x110000.
+ */
+
+void CodeGen::UTF8_DECLARE()
+{
+	if ( red->id->utf8Input && red->getKeyExpr == 0 ) {
+		out <<
+			"	" << ALPH_TYPE() << " _uc = 0;\n"
+			"	int _ul = 0;\n";
+	}
+}
+
+void CodeGen::UTF8_DECODE()
+{
+	if ( !red->id->utf8Input || red->getKeyExpr != 0 )
+		return;
+
+	out <<
+		"	_uc = (unsigned char)" << DEREF( "data", P() ) << ";\n"
+		"	_ul = 0;\n"
+		"	if ( _uc >= 0x80 ) {\n"
+		"		int _un = _uc >= 0xf0 ? 3 : _uc >= 0xe0 ? 2 : _uc >= 0xc0 ? 1 : 0;\n"
+		"		if ( _un == 0 || _uc >= 0xf8";
+
+	if ( !noEnd )
+		out << " || " << PE() << " - " << P() << " <= _un";
+
+	/* Overlong forms, surrogates and values past the last codepoint are not
+	 * well formed either. */
+	out << " )\n"
+		"			_uc = 0x110000;\n"
+		"		else {\n"
+		"			_uc &= 0x3f >> _un;\n"
+		"			while ( _ul < _un && ( " << P() << "[_ul + 1] & 0xc0 ) == 0x80 ) {\n"
+		"				_uc = ( _uc << 6 ) | ( " << P() << "[_ul + 1] & 0x3f );\n"
+		"				_ul += 1;\n"
+		"			}\n"
+		"			if ( _ul < _un || _uc < ( _un == 1 ? 0x80 : _un == 2 ? 0x800 : 0x10000 ) ||\n"
+		"					( _uc >= 0xd800 && _uc <= 0xdfff ) || _uc > 0x10ffff )\n"
+		"				_uc = 0x110000;\n"
+		"			" << P() << " += _ul;\n"
+		"		}\n"
+		"	}\n"
+		"\n";
+}
+
+/* A hold goes back to the first byte of the current character. */
+std::string CodeGen::UTF8_HOLD()
+{
+	if ( red->id->utf8Input && red->getKeyExpr == 0 )
+		return " - _ul";
+	return "";
+}
+
 void CodeGen::NFA_POST_POP()
 {
 	if ( red->nfaPostPopExpr != 0 ) {
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "flat.h"
+#include "redfsm.h"
+#include "gendata.h"
+
+#include <sstream>
+
+using std::ostringstream;
+
+/*
+ * Paged character classes. When the alphabet span is too wide for a flat
+ * class map the reduced machine splits it into pages that are shared where
+ * identical. Writing C directly, the pages are emitted as they are, with a
+ * page index beside them, and the class is found with two loads. Other hosts
+ * get the flat map expanded from the pages.
+ */
+
+bool Flat::pagedClasses()
+{
+	return backend == Direct && redFsm->classPageMap != 0;
+}
+
+void Flat::taCharClassPaged()
+{
+	charClass.start();
+
+	if ( pagedClasses() ) {
+		for ( long long pos = 0; pos < redFsm->numClassPageData; pos++ )
+			charClass.value( redFsm->classMap[pos] );
+	}
+	else {
+		long long maxSpan = keyOps->span( redFsm->lowKey, redFsm->highKey );
+		for ( long long pos = 0; pos < maxSpan; pos++ )
+			charClass.value( redFsm->classAt( pos ) );
+	}
+
+	charClass.finish();
+}
+
+void Flat::taCharClassPages()
+{
+	charClassPages.start();
+
+	if ( pagedClasses() ) {
+		for ( long long p = 0; p < redFsm->numClassPages; p++ )
+			charClassPages.value( redFsm->classPageMap[p] );
+	}
+
+	charClassPages.finish();
+}
+
+/* Expression giving the class of the key at offset off from the low key. */
+std::string Flat::CHAR_CLASS( std::string off )
+{
+	ostringstream ret;
+	if ( ! pagedClasses() ) {
+		ret << CAST("int") << ARR_REF( charClass ) << "[" << off << "]";
+	}
+	else {
+		int bits = redFsm->classPageBits;
+		long long mask = ( 1LL << bits ) - 1;
+		ret << CAST("int") << ARR_REF( charClass ) << "[(" <<
+				CAST("long") << ARR_REF( charClassPages ) << "[(" << off << ") >> " << bits << "] << " <<
+				bits << ") + ((" << off << ") & " << mask << ")]";
+	}
+	return ret.str();
+}
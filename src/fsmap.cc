@@ -645,6 +645,23 @@ void FsmAp::middleEOFAction( int ordering, Action *action )
 	}
 }
 
+/* Tag the final states with the number of the pattern they accept. Unions
+ * merge the tags and minimization keeps states with different tags apart. */
+void FsmAp::matchIdFinStates( int matchId )
+{
+	for ( StateSet::Iter state = finStateSet; state.lte(); state++ )
+		(*state)->matchIds.insert( matchId );
+}
+
+/* Report matches by running the action on entry to any tagged state. */
+void FsmAp::matchIdToStateAction( int ordering, Action *action )
+{
+	for ( StateList::Iter state = stateList; state.lte(); state++ ) {
+		if ( state->matchIds.length() > 0 )
+			state->toStateActionTable.setAction( ordering, action );
+	}
+}
+
 /*
  * Set To State Actions.
  */
@@ -1125,8 +1142,13 @@ int FsmAp::compareStateData( const StateAp *state1, const StateAp *state2 )
 	if ( cmpRes != 0 )
 		return cmpRes;
 	
-	return CmpTable<LongestMatchPart*>::compare(
+	cmpRes = CmpTable<LongestMatchPart*>::compare(
 			state1->lmNfaParts, state2->lmNfaParts );
+	if ( cmpRes != 0 )
+		return cmpRes;
+
+	/* Pattern numbers accepted. */
+	return CmpTable<int>::compare( state1->matchIds, state2->matchIds );
 }
 
 
@@ -1139,6 +1161,7 @@ void FsmAp::clearOutData( StateAp *state )
 	state->outCondKeys.empty();
 	state->outActionTable.empty();
 	state->outPriorTable.empty();
+	state->matchIds.empty();
 }
 
 bool FsmAp::hasOutData( StateAp *state )
@@ -48,6 +48,7 @@ FsmCtx::FsmCtx( FsmGbl *fsmGbl )
 
 	nextPriorKey(0),
 	nextCondId(0),
+	nextCounterRep(0),
 
 	fsmGbl(fsmGbl),
 	generatingSectionSubset(false),
@@ -69,7 +70,9 @@ FsmCtx::FsmCtx( FsmGbl *fsmGbl )
 	actExpr(0),
 	tokstartExpr(0),
 	tokendExpr(0),
-	dataExpr(0)
+	dataExpr(0),
+	lzCacheExpr(0),
+	lzResumeExpr(0)
 {
 	keyOps = new KeyOps;
 	condData = new CondData;
@@ -115,6 +118,10 @@ FsmCtx::~FsmCtx()
 		delete tokendExpr;
 	if ( dataExpr != 0 )
 		delete dataExpr;
+	if ( lzCacheExpr != 0 )
+		delete lzCacheExpr;
+	if ( lzResumeExpr != 0 )
+		delete lzResumeExpr;
 }
 
 /* Graph constructor. */
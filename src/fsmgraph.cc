@@ -25,6 +25,7 @@
 
 #include "fsmgraph.h"
 #include "mergesort.h"
+#include "avlset.h"
 #include "action.h"
 
 using std::endl;
@@ -125,6 +126,214 @@ FsmAp *FsmAp::concatFsmCI( FsmCtx *ctx, Key *str, int len )
 }
 
 
+/*
+ * Direct construction of a minimal acyclic machine from a list of literals,
+ * using the incremental algorithm for sorted input of Daciuk et al. The
+ * machine is built in a light weight node structure, where each node is
+ * registered once its last child is complete, then copied into an FsmAp.
+ */
+
+struct LitWord
+{
+	Key *data;
+	long len;
+};
+
+struct CmpLitWord
+{
+	static int compare( const LitWord &w1, const LitWord &w2 )
+	{
+		long len = w1.len < w2.len ? w1.len : w2.len;
+		for ( long i = 0; i < len; i++ ) {
+			if ( w1.data[i].getVal() < w2.data[i].getVal() )
+				return -1;
+			else if ( w1.data[i].getVal() > w2.data[i].getVal() )
+				return 1;
+		}
+		return w1.len < w2.len ? -1 : ( w1.len > w2.len ? 1 : 0 );
+	}
+};
+
+struct DawgNode;
+
+struct DawgEdge
+{
+	Key key;
+	DawgNode *child;
+};
+
+struct DawgNode
+{
+	DawgNode() : final(false), state(0) {}
+
+	Vector<DawgEdge> edges;
+	bool final;
+	StateAp *state;
+};
+
+/* Nodes are equal if they agree on finality and have the same edges. The
+ * children have already been made unique, so they compare by pointer. */
+struct CmpDawgNode
+{
+	static int compare( DawgNode *const &n1, DawgNode *const &n2 )
+	{
+		if ( n1->final != n2->final )
+			return n1->final ? 1 : -1;
+		if ( n1->edges.length() != n2->edges.length() )
+			return n1->edges.length() < n2->edges.length() ? -1 : 1;
+		for ( int i = 0; i < n1->edges.length(); i++ ) {
+			DawgEdge &e1 = n1->edges[i];
+			DawgEdge &e2 = n2->edges[i];
+			if ( e1.key.getVal() != e2.key.getVal() )
+				return e1.key.getVal() < e2.key.getVal() ? -1 : 1;
+			if ( e1.child != e2.child )
+				return e1.child < e2.child ? -1 : 1;
+		}
+		return 0;
+	}
+};
+
+typedef AvlSet<DawgNode*, CmpDawgNode> DawgRegister;
+
+/* Make the last child of node unique, replacing it with an equivalent node
+ * already registered or registering it. */
+static void dawgReplaceOrRegister( DawgRegister &reg, DawgNode *node )
+{
+	DawgEdge &last = node->edges[node->edges.length()-1];
+	DawgNode *child = last.child;
+	if ( child->edges.length() > 0 )
+		dawgReplaceOrRegister( reg, child );
+
+	AvlSetEl<DawgNode*> *inReg = reg.find( child );
+	if ( inReg != 0 ) {
+		last.child = inReg->key;
+		delete child;
+	}
+	else {
+		reg.insert( child );
+	}
+}
+
+/* Attach the out transitions of a node, which has been given a state. */
+static void dawgAttach( FsmAp *fsm, DawgNode *node, bool caseInsensitive )
+{
+	if ( node->final )
+		fsm->setFinState( node->state );
+
+	if ( !caseInsensitive ) {
+		for ( int e = 0; e < node->edges.length(); e++ ) {
+			DawgEdge &edge = node->edges[e];
+			fsm->attachNewTrans( node->state, edge.child->state,
+					edge.key, edge.key );
+		}
+	}
+	else {
+		/* Out transitions must be attached in key order. */
+		KeySet keySet( fsm->ctx->keyOps );
+		for ( int e = 0; e < node->edges.length(); e++ ) {
+			Key key = node->edges[e].key;
+			keySet.insert( key );
+			if ( key.isLower() )
+				keySet.insert( key.toUpper() );
+		}
+
+		for ( int k = 0; k < keySet.length(); k++ ) {
+			Key key = keySet[k].isUpper() ? keySet[k].toLower() : keySet[k];
+			for ( int e = 0; e < node->edges.length(); e++ ) {
+				if ( node->edges[e].key.getVal() == key.getVal() ) {
+					fsm->attachNewTrans( node->state, node->edges[e].child->state,
+							keySet[k], keySet[k] );
+					break;
+				}
+			}
+		}
+	}
+}
+
+/* Construct an FSM that matches any of a list of literals. The result is
+ * minimal. The literals are sorted first, then each node is found or added in
+ * the register, an AVL tree, so the whole takes O(n log n) in the total length
+ * of the literals. With case insensitivity the literals are folded to
+ * lower case and each letter gets both cases. */
+FsmAp *FsmAp::literalListFsm( FsmCtx *ctx, Key **words, long *lens,
+		long numWords, bool caseInsensitive )
+{
+	LitWord *sorted = new LitWord[numWords];
+	for ( long w = 0; w < numWords; w++ ) {
+		sorted[w].data = words[w];
+		sorted[w].len = lens[w];
+		if ( caseInsensitive ) {
+			for ( long i = 0; i < lens[w]; i++ ) {
+				if ( words[w][i].isUpper() )
+					words[w][i] = words[w][i].toLower();
+			}
+		}
+	}
+
+	MergeSort<LitWord, CmpLitWord> mergeSort;
+	mergeSort.sort( sorted, numWords );
+
+	DawgRegister reg;
+	DawgNode *root = new DawgNode();
+	LitWord prev = { 0, 0 };
+	for ( long w = 0; w < numWords; w++ ) {
+		LitWord &word = sorted[w];
+
+		/* Skip duplicates. */
+		if ( w > 0 && CmpLitWord::compare( prev, word ) == 0 )
+			continue;
+
+		/* Follow the prefix shared with the previous word. Since the input
+		 * is sorted, it runs along the last edges. */
+		long prefix = 0;
+		DawgNode *node = root;
+		while ( prefix < word.len && node->edges.length() > 0 ) {
+			DawgEdge &last = node->edges[node->edges.length()-1];
+			if ( last.key.getVal() != word.data[prefix].getVal() )
+				break;
+			node = last.child;
+			prefix += 1;
+		}
+
+		/* Everything below the divergence point is complete. */
+		if ( node->edges.length() > 0 )
+			dawgReplaceOrRegister( reg, node );
+
+		/* Add the suffix. */
+		for ( long i = prefix; i < word.len; i++ ) {
+			DawgEdge edge;
+			edge.key = word.data[i];
+			edge.child = new DawgNode();
+			node->edges.append( edge );
+			node = edge.child;
+		}
+		node->final = true;
+
+		prev = word;
+	}
+
+	if ( root->edges.length() > 0 )
+		dawgReplaceOrRegister( reg, root );
+
+	/* Copy into the fsm. The register holds every node but the root. */
+	FsmAp *fsm = new FsmAp( ctx );
+	root->state = fsm->addState();
+	fsm->setStartState( root->state );
+	for ( DawgRegister::Iter n = reg; n.lte(); n++ )
+		n->key->state = fsm->addState();
+
+	dawgAttach( fsm, root, caseInsensitive );
+	for ( DawgRegister::Iter n = reg; n.lte(); n++ )
+		dawgAttach( fsm, n->key, caseInsensitive );
+
+	for ( DawgRegister::Iter n = reg; n.lte(); n++ )
+		delete n->key;
+	delete root;
+	delete[] sorted;
+
+	return fsm;
+}
+
 /* Construct a machine that matches one character.  A new machine will be made
  * that has two states with a single transition between the states. */
 FsmAp *FsmAp::concatFsm( FsmCtx *ctx, Key chr )
@@ -748,6 +957,51 @@ FsmRes FsmAp::questionOp( FsmAp *fsm )
 	return res;
 }
 
+/* Concatenates times copies of fsm in about 2 log(times) concatenations
+ * rather than times - 1. Pieces of 1, 2, 4, ... copies are each made by
+ * concatenating the piece before with a copy of itself, and the pieces for the
+ * bits of times are joined. All copies are the same machine, so by
+ * associativity this is the chain of copies. The later concatenations are of
+ * larger machines, so fewer of them need not take less time; repperf in the
+ * test directory compares the two. */
+FsmRes FsmAp::repeatByDoubling( FsmAp *fsm, int times )
+{
+	FsmAp *piece = fsm;
+	FsmAp *result = 0;
+
+	while ( true ) {
+		if ( times & 1 ) {
+			FsmAp *use = times > 1 ? new FsmAp( *piece ) : piece;
+			if ( result == 0 )
+				result = use;
+			else {
+				FsmRes res = concatOp( result, use );
+				if ( !res.success() ) {
+					if ( times > 1 )
+						delete piece;
+					return res;
+				}
+				result = res.fsm;
+			}
+		}
+
+		times >>= 1;
+		if ( times == 0 )
+			break;
+
+		FsmRes res = concatOp( piece, new FsmAp( *piece ) );
+		if ( !res.success() ) {
+			delete result;
+			return res;
+		}
+		piece = res.fsm;
+	}
+
+	result->afterOpMinimize();
+
+	return FsmRes( FsmRes::Fsm(), result );
+}
+
 FsmRes FsmAp::exactRepeatOp( FsmAp *fsm, int times )
 {
 	/* Zero repetitions produces lambda machine. */
@@ -765,6 +1019,11 @@ FsmRes FsmAp::exactRepeatOp( FsmAp *fsm, int times )
 	if ( times == 1 )
 		return FsmRes( FsmRes::Fsm(), fsm );
 
+	/* Guarded priorities go on everything before each copy as it is added,
+	 * which only the chain of copies gets right. */
+	if ( fsm->startState->guardedInTable.length() == 0 )
+		return repeatByDoubling( fsm, times );
+
 	/* Make a machine to make copies from. */
 	FsmAp *copyFrom = new FsmAp( *fsm );
 
@@ -806,6 +1065,19 @@ FsmRes FsmAp::maxRepeatOp( FsmAp *fsm, int times )
 		return FsmRes( FsmRes::Fsm(), fsm );
 	}
 
+	/* Without pending out data, e{0,n} is n copies of e{0,1}. With it, only
+	 * the final states of the last copy may go on to the next, which the
+	 * chain below takes care of. */
+	bool anyOutData = fsm->startState->guardedInTable.length() > 0;
+	for ( StateSet::Iter st = fsm->finStateSet; st.lte() && !anyOutData; st++ )
+		anyOutData = fsm->hasOutData( *st );
+
+	if ( !anyOutData ) {
+		isolateStartState( fsm );
+		fsm->setFinState( fsm->startState );
+		return repeatByDoubling( fsm, times );
+	}
+
 	/* Make a machine to make copies from. */
 	FsmAp *copyFrom = new FsmAp( *fsm );
 
@@ -1387,6 +1659,7 @@ void FsmAp::mergeStateProperties( StateAp *destState, StateAp *srcState )
 		destState->errActionTable.setActions( srcState->errActionTable );
 		destState->eofActionTable.setActions( srcState->eofActionTable );
 		destState->lmNfaParts.insert( srcState->lmNfaParts );
+		destState->matchIds.insert( srcState->matchIds );
 		destState->guardedInTable.setPriors( srcState->guardedInTable );
 	}
 }
@@ -111,7 +111,8 @@ StateAp::StateAp()
 	errActionTable(),
 	eofActionTable(),
 	guardedInTable(),
-	lmNfaParts()
+	lmNfaParts(),
+	matchIds()
 {
 }
 
@@ -162,7 +163,8 @@ StateAp::StateAp(const StateAp &other)
 	eofActionTable(other.eofActionTable),
 
 	guardedInTable(other.guardedInTable),
-	lmNfaParts(other.lmNfaParts)
+	lmNfaParts(other.lmNfaParts),
+	matchIds(other.matchIds)
 {
 	/* Duplicate all the transitions. */
 	for ( TransList::Iter trans = other.outList; trans.lte(); trans++ ) {
@@ -0,0 +1,340 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ragel.h"
+#include "codegen.h"
+#include "redfsm.h"
+#include "gendata.h"
+#include "inputdata.h"
+
+#include <string.h>
+
+using std::ostream;
+using std::endl;
+using std::vector;
+
+/*
+ * Fused exec. A group of machines is run over the input in one loop. The
+ * byte is loaded once and looked up once in a class table shared by the
+ * group. Each machine then steps its own cs through a flat table over the
+ * shared classes, and runs its own transition actions. No product of the
+ * machines is built.
+ */
+
+/* Actions may only use p, the current character and the current state. Any
+ * movement of p or cs belongs to one machine and would break the lockstep. */
+static bool fusedInlineOk( GenInlineList *inlineList )
+{
+	if ( inlineList == 0 )
+		return true;
+
+	for ( GenInlineList::Iter item = *inlineList; item.lte(); item++ ) {
+		switch ( item->type ) {
+			case GenInlineItem::Text:
+			case GenInlineItem::PChar:
+			case GenInlineItem::Char:
+			case GenInlineItem::Curs:
+			case GenInlineItem::HostStmt:
+			case GenInlineItem::HostExpr:
+			case GenInlineItem::HostText:
+			case GenInlineItem::GenStmt:
+			case GenInlineItem::GenExpr:
+				break;
+			default:
+				return false;
+		}
+
+		if ( !fusedInlineOk( item->children ) )
+			return false;
+	}
+	return true;
+}
+
+/* Actions that read the current state get it from the member's own copy. */
+static bool fusedUsesCurs( GenInlineList *inlineList )
+{
+	if ( inlineList == 0 )
+		return false;
+
+	for ( GenInlineList::Iter item = *inlineList; item.lte(); item++ ) {
+		if ( item->type == GenInlineItem::Curs || fusedUsesCurs( item->children ) )
+			return true;
+	}
+	return false;
+}
+
+static const char *fusedType( long max )
+{
+	if ( max < 256 )
+		return "unsigned char";
+	if ( max < 65536 )
+		return "unsigned short";
+	return "int";
+}
+
+/* One member of the group, stepped over all 256 bytes. */
+struct FusedMember
+{
+	FusedMember( CodeGen *cg )
+	:
+		cg( cg ),
+		errId( 0 ),
+		numRows( 0 ),
+		anyAct( false ),
+		usesCurs( false ),
+		targ( 0 ),
+		act( 0 )
+	{}
+
+	~FusedMember()
+	{
+		delete[] targ;
+		delete[] act;
+	}
+
+	CodeGen *cg;
+	long errId;
+	long numRows;
+	bool anyAct;
+	bool usesCurs;
+	long *targ;
+	long *act;
+};
+
+static void fusedSet( FusedMember *m, bool isSigned, RedStateAp *st, RedTransList &list )
+{
+	for ( RedTransList::Iter rtel = list; rtel.lte(); rtel++ ) {
+		RedCondPair *pair = rtel->value->outCond( 0 );
+		long t = pair->targ != 0 ? pair->targ->id : m->errId;
+		long a = pair->action != 0 ? pair->action->actListId + 1 : 0;
+
+		for ( long long v = rtel->lowKey.getVal(); v <= rtel->highKey.getVal(); v++ ) {
+			unsigned char u = (unsigned char) ( isSigned ? (signed char)v : v );
+			m->targ[st->id * 256 + u] = t;
+			m->act[st->id * 256 + u] = a;
+		}
+	}
+}
+
+bool CodeGen::fusedMachineOk()
+{
+	if ( red->condSpaceList.length() > 0 || redFsm->anyNfaStates() ||
+			redFsm->anyEofActivity() || redFsm->anyFromStateActions() ||
+			redFsm->anyToStateActions() )
+		return false;
+
+	for ( GenActionList::Iter act = red->actionList; act.lte(); act++ ) {
+		if ( !fusedInlineOk( act->inlineList ) )
+			return false;
+	}
+	return true;
+}
+
+void CodeGen::writeFused( InputLoc &loc, vector<CodeGenData*> &group )
+{
+	if ( backend != Direct ) {
+		red->id->error(loc) << "fused exec requires C" << endl;
+		return;
+	}
+
+	vector<FusedMember*> members;
+	for ( vector<CodeGenData*>::iterator g = group.begin(); g != group.end(); g++ ) {
+		CodeGen *cg = static_cast<CodeGen*>( *g );
+
+		if ( cg->alphType->size != 1 ) {
+			red->id->error(loc) << cg->fsmName << ": fused exec requires a "
+					"one byte alphabet" << endl;
+		}
+		else if ( !cg->fusedMachineOk() ) {
+			red->id->error(loc) << cg->fsmName << ": fused exec allows only "
+					"transition actions that leave p and cs alone, and no "
+					"conditions, eof actions or nfa states" << endl;
+		}
+
+		for ( vector<FusedMember*>::iterator m = members.begin(); m != members.end(); m++ ) {
+			if ( (*m)->cg->vCS() == cg->vCS() ) {
+				red->id->error(loc) << cg->fsmName << ": fused machines need "
+						"distinct cs variables, shared with " <<
+						(*m)->cg->fsmName << endl;
+			}
+		}
+
+		FusedMember *m = new FusedMember( cg );
+		for ( GenActionList::Iter act = cg->red->actionList; act.lte(); act++ )
+			m->usesCurs = m->usesCurs || fusedUsesCurs( act->inlineList );
+		members.push_back( m );
+	}
+
+	if ( red->id->errorCount > 0 ) {
+		for ( vector<FusedMember*>::iterator m = members.begin(); m != members.end(); m++ )
+			delete *m;
+		return;
+	}
+
+	/* Step every state of every member over every byte. Bytes no transition
+	 * covers go to the error state. A machine without one has every byte
+	 * covered, but gets a row of its own anyway. */
+	for ( vector<FusedMember*>::iterator m = members.begin(); m != members.end(); m++ ) {
+		RedFsmAp *fsm = (*m)->cg->redFsm;
+		bool isSigned = (*m)->cg->alphType->isSigned;
+
+		(*m)->errId = fsm->errState != 0 ? fsm->errState->id : fsm->nextStateId;
+		(*m)->numRows = fsm->nextStateId + ( fsm->errState != 0 ? 0 : 1 );
+		(*m)->targ = new long[(*m)->numRows * 256];
+		(*m)->act = new long[(*m)->numRows * 256];
+
+		for ( long i = 0; i < (*m)->numRows * 256; i++ ) {
+			(*m)->targ[i] = (*m)->errId;
+			(*m)->act[i] = 0;
+		}
+
+		for ( RedStateList::Iter st = fsm->stateList; st.lte(); st++ ) {
+			if ( st->defTrans != 0 ) {
+				RedCondPair *pair = st->defTrans->outCond( 0 );
+				for ( int u = 0; u < 256; u++ ) {
+					(*m)->targ[st->id * 256 + u] = pair->targ != 0 ? pair->targ->id : (*m)->errId;
+					(*m)->act[st->id * 256 + u] = pair->action != 0 ? pair->action->actListId + 1 : 0;
+				}
+			}
+			fusedSet( *m, isSigned, st, st->outRange );
+			fusedSet( *m, isSigned, st, st->outSingle );
+		}
+	}
+
+	/* Shared classes. Two bytes are in one class when every state of every
+	 * member does the same on both. */
+	int classOf[256], rep[256], numClasses = 0;
+	for ( int u = 0; u < 256; u++ ) {
+		int c = 0;
+		for ( ; c < numClasses; c++ ) {
+			bool same = true;
+			for ( vector<FusedMember*>::iterator m = members.begin(); same && m != members.end(); m++ ) {
+				for ( long s = 0; same && s < (*m)->numRows; s++ ) {
+					same = (*m)->targ[s * 256 + u] == (*m)->targ[s * 256 + rep[c]] &&
+							(*m)->act[s * 256 + u] == (*m)->act[s * 256 + rep[c]];
+				}
+			}
+			if ( same )
+				break;
+		}
+
+		if ( c == numClasses )
+			rep[numClasses++] = u;
+		classOf[u] = c;
+	}
+
+	if ( red->id->printStatistics ) {
+		red->id->stats() << "fused-machines\t" << members.size() << endl;
+		red->id->stats() << "fused-classes\t" << numClasses << endl;
+	}
+
+	out <<
+		"	{\n"
+		"	static const " << fusedType( numClasses ) << " _fz_class[] = {";
+	for ( int u = 0; u < 256; u++ )
+		out << ( u % 16 == 0 ? "\n\t\t" : " " ) << classOf[u] << ",";
+	out << "\n\t};\n";
+
+	for ( size_t i = 0; i < members.size(); i++ ) {
+		FusedMember *m = members[i];
+		long len = m->numRows * numClasses;
+
+		out << "	static const " << fusedType( m->numRows ) << " _fz" << i << "_targ[] = {";
+		for ( long x = 0; x < len; x++ ) {
+			out << ( x % 16 == 0 ? "\n\t\t" : " " ) <<
+					m->targ[( x / numClasses ) * 256 + rep[x % numClasses]] << ",";
+		}
+		out << "\n\t};\n";
+
+		for ( long x = 0; x < m->numRows * 256; x++ )
+			m->anyAct = m->anyAct || m->act[x] != 0;
+
+		if ( m->anyAct ) {
+			out << "	static const " << fusedType( m->cg->redFsm->actionMap.length() + 1 ) <<
+					" _fz" << i << "_act[] = {";
+			for ( long x = 0; x < len; x++ ) {
+				out << ( x % 16 == 0 ? "\n\t\t" : " " ) <<
+						m->act[( x / numClasses ) * 256 + rep[x % numClasses]] << ",";
+			}
+			out << "\n\t};\n";
+		}
+	}
+
+	out <<
+		"	unsigned int _fz_c;\n"
+		"	while ( " << P() << " != " << PE() << " ) {\n"
+		"		_fz_c = _fz_class[(unsigned char)" << GET_KEY() << "];\n";
+
+	for ( size_t i = 0; i < members.size(); i++ ) {
+		FusedMember *m = members[i];
+		CodeGen *cg = m->cg;
+		std::string cell = cg->vCS() + " * " + STR( numClasses ) + " + _fz_c";
+
+		out << "		if ( " << cg->vCS() << " != " << m->errId << " ) {\n";
+
+		if ( m->anyAct ) {
+			if ( m->usesCurs ) {
+				out << "		" << cg->INT() << " " << cg->ps.name << " = " <<
+						cg->vCS() << ";\n";
+			}
+
+			out << "		switch ( _fz" << i << "_act[" << cell << "] ) {\n";
+			for ( GenActionTableMap::Iter redAct = cg->redFsm->actionMap; redAct.lte(); redAct++ ) {
+				if ( redAct->numTransRefs == 0 )
+					continue;
+
+				out << "		case " << redAct->actListId + 1 << ": {\n";
+				for ( GenActionTable::Iter item = redAct->key; item.lte(); item++ )
+					cg->ACTION( out, item->value, IlOpts( 0, false, false ) );
+				out << "		break; }\n";
+			}
+			out << "		}\n";
+		}
+
+		out <<
+			"		" << cg->vCS() << " = _fz" << i << "_targ[" << cell << "];\n"
+			"		}\n";
+	}
+
+	/* Stop on the byte that takes the last machine out. */
+	bool allErr = true;
+	for ( size_t i = 0; i < members.size(); i++ )
+		allErr = allErr && members[i]->cg->redFsm->errState != 0;
+
+	if ( allErr ) {
+		out << "		if ( ";
+		for ( size_t i = 0; i < members.size(); i++ ) {
+			out << ( i > 0 ? " && " : "" ) << members[i]->cg->vCS() <<
+					" == " << members[i]->errId;
+		}
+		out << " )\n"
+			"			break;\n";
+	}
+
+	out <<
+		"		" << P() << " += 1;\n"
+		"	}\n"
+		"	}\n";
+
+	for ( vector<FusedMember*>::iterator m = members.begin(); m != members.end(); m++ )
+		delete *m;
+}
@@ -28,6 +28,7 @@
 #include "version.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <iostream>
 
 string itoa( int i )
@@ -343,6 +344,9 @@ void Reducer::makeSetAct( GenInlineList *outList, long lmId )
 	GenInlineItem *inlineItem = new GenInlineItem( InputLoc(), GenInlineItem::LmSetActId );
 	inlineItem->lmId = lmId;
 	outList->append( inlineItem );
+
+	if ( lmId > maxLmId )
+		maxLmId = lmId;
 }
 
 void Reducer::makeGenInlineList( GenInlineList *outList, InlineList *inList )
@@ -807,6 +811,11 @@ void Reducer::makeStateList()
 		if ( st->isFinState() )
 			setFinal( curState );
 
+		if ( st->matchIds.length() > 0 ) {
+			allStates[curState].matchIds.setAs(
+					st->matchIds.data, st->matchIds.length() );
+		}
+
 		if ( st->nfaOut != 0 ) {
 			RedStateAp *from = allStates + curState;
 			from->nfaTargs = new RedNfaTargs;
@@ -962,6 +971,16 @@ void Reducer::make( const HostLang *hostLang, const HostType *alphType )
 		dataExpr = new GenInlineList;
 		makeGenInlineList( dataExpr, fsmCtx->dataExpr );
 	}
+
+	if ( fsmCtx->lzCacheExpr != 0 ) {
+		lzCacheExpr = new GenInlineList;
+		makeGenInlineList( lzCacheExpr, fsmCtx->lzCacheExpr );
+	}
+
+	if ( fsmCtx->lzResumeExpr != 0 ) {
+		lzResumeExpr = new GenInlineList;
+		makeGenInlineList( lzResumeExpr, fsmCtx->lzResumeExpr );
+	}
 	
 	makeExports();
 	makeMachine();
@@ -1499,6 +1518,56 @@ void Reducer::setValueLimits()
 	}
 }
 
+bool Reducer::nfaMemoSafe( GenInlineList *inlineList )
+{
+	for ( GenInlineList::Iter item = *inlineList; item.lte(); item++ ) {
+		if ( item->type == GenInlineItem::Exec || item->type == GenInlineItem::NextExpr )
+			return false;
+
+		if ( item->children != 0 && !nfaMemoSafe( item->children ) )
+			return false;
+	}
+	return true;
+}
+
+/* A push can be dropped if the same state was pushed at the same position
+ * before. That only holds if nothing but the state and position decide the
+ * outcome: no conditions, no pop tests, no call stack and no control flow
+ * computed from user data. Nor may an alternative carry push actions, they
+ * would be dropped with the push. */
+bool Reducer::nfaMemoSafe()
+{
+	if ( id->hostLang->backend != Direct )
+		return false;
+
+	if ( condSpaceList.length() > 0 )
+		return false;
+
+	if ( redFsm->bAnyActionCalls || redFsm->bAnyActionNcalls ||
+			redFsm->bAnyActionRets || redFsm->bAnyActionNrets ||
+			redFsm->bAnyActionByValControl || redFsm->bUsingAct )
+		return false;
+
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st->nfaTargs != 0 ) {
+			for ( RedNfaTargs::Iter nt = *st->nfaTargs; nt.lte(); nt++ ) {
+				if ( nt->push != 0 || nt->popTest != 0 )
+					return false;
+			}
+		}
+	}
+
+	for ( GenActionList::Iter act = actionList; act.lte(); act++ ) {
+		if ( act->numNfaPopTestRefs > 0 )
+			return false;
+
+		if ( act->numRefs() > 0 && act->inlineList != 0 && !nfaMemoSafe( act->inlineList ) )
+			return false;
+	}
+
+	return true;
+}
+
 /* Gather various info on the machine. */
 void Reducer::analyzeMachine()
 {
@@ -1595,6 +1664,57 @@ void Reducer::analyzeMachine()
 			redFsm->bAnyNfaCondRefs = true;
 	}
 
+	/* The visited set is only used when the backtracking can repeat itself
+	 * and a repeat is sure to end the same way as the first attempt. */
+	if ( redFsm->bAnyNfaStates ) {
+		redFsm->nfaMemoAnalysis();
+
+		if ( id->nfaMemo && redFsm->bNfaMemoNeeded && nfaMemoSafe() )
+			redFsm->bNfaMemo = true;
+
+		if ( id->printStatistics ) {
+			id->stats() << "nfa-memo-needed\t" <<
+					( redFsm->bNfaMemoNeeded ? "yes" : "no" ) << std::endl;
+		}
+	}
+
+	/* Static bounds on the stacks the host code sizes. */
+	bool calls = redFsm->bAnyActionCalls || redFsm->bAnyActionNcalls;
+	if ( calls || redFsm->bAnyNfaStates ) {
+		redFsm->stackDepths();
+
+		if ( id->printStatistics && calls ) {
+			id->stats() << "max-stack\t";
+			if ( redFsm->maxStack >= 0 )
+				id->stats() << redFsm->maxStack << std::endl;
+			else
+				id->stats() << "unbounded" << std::endl;
+
+			/* The states that start the frames of a recursive cycle. */
+			if ( redFsm->stackCycle.length() > 0 ) {
+				id->stats() << "max-stack-cycle\t";
+				for ( Vector<int>::Iter c = redFsm->stackCycle; c.lte(); c++ )
+					id->stats() << ( c.pos() > 0 ? " " : "" ) << *c;
+				id->stats() << " " << redFsm->stackCycle[0] << std::endl;
+			}
+		}
+
+		if ( id->printStatistics && redFsm->bAnyNfaStates ) {
+			id->stats() << "max-nfa-stack\t";
+			if ( redFsm->maxNfaStack >= 0 )
+				id->stats() << redFsm->maxNfaStack << std::endl;
+			else
+				id->stats() << "unbounded" << std::endl;
+		}
+	}
+
+	/* Bytes after which the machine is always in the same state. */
+	if ( id->printStatistics ) {
+		long numSync = redFsm->syncAnalysis( hasLongestMatch );
+		if ( redFsm->syncTargs.length() > 0 )
+			id->stats() << "sync-bytes\t" << numSync << std::endl;
+	}
+
 	/* Assign ids to actions that are referenced. */
 	assignActionIds();
 
@@ -1647,6 +1767,36 @@ void CodeGenData::collectReferences()
 	}
 }
 
+void CodeGenData::writeFused( InputLoc &loc, std::vector<CodeGenData*> & )
+{
+	red->id->error(loc) << "fused exec is not supported by this code style" << std::endl;
+}
+
+void CodeGenData::writeState( InputLoc &loc, long )
+{
+	red->id->error(loc) << "write state is not supported by this code style" << std::endl;
+}
+
+void CodeGenData::writeSync( InputLoc &loc )
+{
+	red->id->error(loc) << "write sync is not supported by this code style" << std::endl;
+}
+
+/* Write statement for a group of machines run in one loop. The group is
+ * resolved by the caller, from the section names following the command. */
+void CodeGenData::writeFusedStatement( InputLoc &loc, std::vector<CodeGenData*> &group )
+{
+	out << '\n';
+
+	if ( cleared ) {
+		red->id->error(loc) << "write statement following a clear is invalid" << std::endl;
+		return;
+	}
+
+	genOutputLineDirective( out );
+	writeFused( loc, group );
+}
+
 void CodeGenData::writeStatement( InputLoc &loc, int nargs,
 		std::vector<std::string> &args, bool generateDot, const HostLang *hostLang )
 {
@@ -1688,6 +1838,7 @@ void CodeGenData::writeStatement( InputLoc &loc, int nargs,
 			else
 				write_option_error( loc, args[i] );
 		}
+		wroteInitExec = true;
 		writeInit();
 	}
 	else if ( args[0] == "exec" ) {
@@ -1697,6 +1848,7 @@ void CodeGenData::writeStatement( InputLoc &loc, int nargs,
 			else
 				write_option_error( loc, args[i] );
 		}
+		wroteInitExec = true;
 		collectReferences();
 		writeExec();
 	}
@@ -1720,6 +1872,31 @@ void CodeGenData::writeStatement( InputLoc &loc, int nargs,
 			write_option_error( loc, args[i] );
 		writeError();
 	}
+	else if ( args[0] == "state" ) {
+		/* Init and exec already written use the plain variables. */
+		if ( wroteInitExec ) {
+			red->id->error(loc) << "write state must come before write init "
+					"and write exec" << std::endl;
+			return;
+		}
+
+		/* The optional argument is the depth of the call stack. */
+		long stackSize = 0;
+		for ( int i = 1; i < nargs; i++ ) {
+			char *end;
+			long depth = strtol( args[i].c_str(), &end, 10 );
+			if ( i == 1 && *end == 0 && depth > 0 )
+				stackSize = depth;
+			else
+				write_option_error( loc, args[i] );
+		}
+		writeState( loc, stackSize );
+	}
+	else if ( args[0] == "sync" ) {
+		for ( int i = 1; i < nargs; i++ )
+			write_option_error( loc, args[i] );
+		writeSync( loc );
+	}
 	else if ( args[0] == "clear" ) {
 		for ( int i = 1; i < nargs; i++ )
 			write_option_error( loc, args[i] );
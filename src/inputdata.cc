@@ -41,6 +41,7 @@
 #include <fstream>
 #include <unistd.h>
 #include <sstream>
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -91,6 +92,9 @@ InputData::~InputData()
 	if ( histogramFn != 0 )
 		::free( (void*)histogramFn );
 
+	if ( blobFileName != 0 )
+		::free( (void*)blobFileName );
+
 	if ( histogram != 0 )
 		delete[] histogram;
 
@@ -122,6 +126,12 @@ void InputData::createOutputStream()
 					"\" is the same as the input file" << endl;
 		}
 
+		/* Table blobs go next to the output. */
+		if ( blobTables ) {
+			string fn = string( outputFileName ) + ".bin";
+			blobFileName = strdup( fn.c_str() );
+		}
+
 		/* Create the filter on the output and open it. */
 		outFilter = new output_filter( outputFileName );
 
@@ -130,6 +140,8 @@ void InputData::createOutputStream()
 	}
 	else {
 		/* Writing out to std out. */
+		if ( blobTables )
+			error() << "--blob-tables requires an output file" << endp;
 		outStream = &std::cout;
 	}
 }
@@ -219,6 +231,39 @@ void InputData::verifyWritesHaveData()
 		verifyWriteHasData( ii );
 }
 
+/* The group is the section holding the write, followed by the sections
+ * named in it. */
+void InputData::writeFused( InputItem *ii )
+{
+	std::vector<CodeGenData*> group;
+	group.push_back( ii->pd->cgd );
+
+	for ( size_t i = 1; i < ii->writeArgs.size(); i++ ) {
+		ParseDataDictEl *pdEl = parseDataDict.find( ii->writeArgs[i] );
+		if ( pdEl == 0 ) {
+			error( ii->loc ) << "fused exec: no machine section named \"" <<
+					ii->writeArgs[i] << "\"" << endl;
+		}
+		else if ( pdEl->value->cgd == 0 ) {
+			error( ii->loc ) << ii->writeArgs[i] << ": no machine "
+					"instantiations to write" << endl;
+		}
+		else if ( std::find( group.begin(), group.end(), pdEl->value->cgd ) != group.end() ) {
+			error( ii->loc ) << ii->writeArgs[i] << ": machine given twice "
+					"to fused exec" << endl;
+		}
+		else {
+			group.push_back( pdEl->value->cgd );
+		}
+	}
+
+	if ( group.size() < 2 )
+		error( ii->loc ) << "fused exec needs at least one other machine" << endl;
+
+	if ( errorCount == 0 )
+		ii->pd->cgd->writeFusedStatement( ii->loc, group );
+}
+
 void InputData::writeOutput( InputItem *ii )
 {
 	/* If it is the first input item then check if we need to write the BOM. */
@@ -228,8 +273,12 @@ void InputData::writeOutput( InputItem *ii )
 	switch ( ii->type ) {
 		case InputItem::Write: {
 			CodeGenData *cgd = ii->pd->cgd;
-			cgd->writeStatement( ii->loc, ii->writeArgs.size(),
-					ii->writeArgs, generateDot, hostLang );
+			if ( ii->writeArgs[0] == "fused" )
+				writeFused( ii );
+			else {
+				cgd->writeStatement( ii->loc, ii->writeArgs.size(),
+						ii->writeArgs, generateDot, hostLang );
+			}
 			break;
 		}
 		case InputItem::HostData: {
@@ -265,6 +314,15 @@ void InputData::closeOutput()
 		delete outStream;
 		delete outFilter;
 	}
+
+	if ( blobFileName != 0 ) {
+		ofstream blob( blobFileName, ios::out|ios::trunc|ios::binary );
+		blob.write( blobData.data(), blobData.length() );
+		if ( !blob ) {
+			error() << "error writing " << blobFileName << endl;
+			abortCompile( 1 );
+		}
+	}
 }
 
 void InputData::writeDot( ostream &out )
@@ -591,6 +649,8 @@ void InputData::usage()
 "   --asm --gas-x86-64-sys-v\n"
 "                        GNU AS, x86_64, System V ABI.\n"
 "                        Generated in a code style equivalent to -G2\n"
+"   --asm-unroll[=N]     With --asm, check for the end of the buffer once per\n"
+"                        N characters (default 4) when that many remain\n"
 "   -D                   D           All code styles supported\n"
 "   -Z                   Go          All code styles supported\n"
 "   -A                   C#          -T0 -T1 -F0 -F1 -G0 -G1\n"
@@ -608,13 +668,55 @@ void InputData::usage()
 "   -T1                  Binary search with expanded actions \n"
 "   -F0                  Flat table\n"
 "   -F1                  Flat table with expanded actions\n"
+"   -T2                  Binary search with threaded actions (C only, falls\n"
+"                        back to -T1 without GNU C labels as values)\n"
+"   -F2                  Flat table with threaded actions (C only, falls\n"
+"                        back to -F1 without GNU C labels as values)\n"
+"   -T3                  Binary search with the actions lists run most often\n"
+"                        expanded and the rest looped (falls back to -T0\n"
+"                        without goto)\n"
+"   -F3                  Flat table with the actions lists run most often\n"
+"                        expanded and the rest looped (falls back to -F0\n"
+"                        without goto)\n"
+"   --hybrid-threshold=P With -T3 and -F3, expand the action lists estimated to\n"
+"                        run on at least P percent of the input (default 1).\n"
+"                        Estimates use --input-histogram if given\n"
 "   -G0                  Switch-driven\n"
 "   -G1                  Switch-driven with expanded actions\n"
 "   -G2                  Goto-driven with expanded actions\n"
+"   --eytzinger-search   With -T0 to -T3 lay out the keys of large states\n"
+"                        for a branchless search (C only)\n"
+"   --keyword-hash       For machines that accept a small, finite set of words,\n"
+"                        look up the whole of p .. pe in a perfect hash first;\n"
+"                        otherwise as -T0 (C only, output needs <string.h>)\n"
+"   --nfa-memo           Skip NFA pushes of a state already pushed at the same\n"
+"                        position, bounding backtracking by input length times\n"
+"                        states. Used when -s reports nfa-memo-needed and the\n"
+"                        machine allows it (C only, needs nfa_memo, <string.h>)\n"
+"   --utf8               Build machines over codepoints. Literals are read as\n"
+"                        UTF-8 and the input is decoded as it is scanned.\n"
+"                        With -T0, -T1, -T3, -F0, -F1 and -F3 (C only)\n"
 "large machines:\n"
 "   --integral-tables    Use integers for table data (default)\n"
 "   --string-tables      Encode table data into strings for faster host lang\n"
 "                        compilation\n"
+"   --blob-tables        Write table data to <output>.bin and include it with\n"
+"                        .incbin (C only, ELF targets, little-endian). Compile\n"
+"                        with -Wa,-I<dir> when <dir> holds the output\n"
+"   --share-tables       Write tables with the same content once per output\n"
+"                        file; later machines point at the first copy (C only,\n"
+"                        needs every write data at file scope)\n"
+"   --match-ids          Number the alternatives of each instantiated union,\n"
+"                        write the numbers each state accepts and run the\n"
+"                        action named match on entering one (C only)\n"
+"   --counter-reps[=N]   Build a repetition of a character class with a bound\n"
+"                        of N or more (default 256) as a loop counting in\n"
+"                        reps[] or variable reps, sized by num_reps in write\n"
+"                        data (C only)\n"
+"   --checkpoints[=N]    Record the offset and state of a scanner at the first\n"
+"                        token start after every N bytes (default 4096) in\n"
+"                        ckpts, and stop a rescan where it meets the records\n"
+"                        of the last scan (C only)\n"
 "analysis:\n"
 "   --prior-interaction          Search for condition-based general repetitions\n"
 "                                that will not function properly due to state mod\n"
@@ -623,10 +725,21 @@ void InputData::usage()
 "                                of the machine (depth D from start state).\n"
 "   --state-limit=L              Report fail if number of states exceeds this\n"
 "                                during compilation.\n"
+"   --nfa-fallback[=F]           If a top-level union grows beyond F times the\n"
+"                                states of its operands (default 10), make it an\n"
+"                                NFA union, with the depth of lowest breadth cost\n"
+"                                that stays under that size.\n"
+"   --lazy-dfa[=K]               If a top-level union exceeds --state-limit,\n"
+"                                build each alternative alone and generate a\n"
+"                                runtime that makes DFA states on demand, with a\n"
+"                                cache of K states (default 1024). C only, for\n"
+"                                machines without actions or conditions.\n"
 "   --breadth-check=E1,E2,..     Report breadth cost of named entry points and\n"
 "                                the start state.\n"
 "   --input-histogram=FN         Input char histogram for breadth check. If\n"
-"                                unspecified a flat histogram is used.\n"
+"                                unspecified a flat histogram is used. With\n"
+"                                -G2 it also picks default transitions and\n"
+"                                tests the hottest one first.\n"
 "testing:\n"
 "   --kelbt-frontend        Compile using original ragel + kelbt frontend\n"
 "                           Requires ragel be built with ragel + kelbt support\n"
@@ -976,10 +1089,32 @@ void InputData::parseArgs( int argc, const char **argv )
 					frontend = ReduceBased;
 					frontendSpecified = true;
 				}
-				else if ( strcmp( arg, "string-tables" ) == 0 )
+				else if ( strcmp( arg, "string-tables" ) == 0 ) {
 					stringTables = true;
-				else if ( strcmp( arg, "integral-tables" ) == 0 )
+					blobTables = false;
+				}
+				else if ( strcmp( arg, "integral-tables" ) == 0 ) {
 					stringTables = false;
+					blobTables = false;
+				}
+				else if ( strcmp( arg, "blob-tables" ) == 0 ) {
+					blobTables = true;
+					stringTables = false;
+				}
+				else if ( strcmp( arg, "match-ids" ) == 0 )
+					matchIds = true;
+				else if ( strcmp( arg, "counter-reps" ) == 0 ) {
+					counterReps = eq != 0 ? strtol( eq, 0, 10 ) : 256;
+					if ( counterReps <= 0 )
+						error() << "invalid bound for --counter-reps" << endl;
+				}
+				else if ( strcmp( arg, "checkpoints" ) == 0 ) {
+					checkpoints = eq != 0 ? strtol( eq, 0, 10 ) : 4096;
+					if ( checkpoints <= 0 )
+						error() << "invalid spacing for --checkpoints" << endl;
+				}
+				else if ( strcmp( arg, "share-tables" ) == 0 )
+					shareTables = true;
 				else if ( strcmp( arg, "supported-frontends" ) == 0 )
 					showFrontends();
 				else if ( strcmp( arg, "supported-backends" ) == 0 )
@@ -993,6 +1128,16 @@ void InputData::parseArgs( int argc, const char **argv )
 					condsCheckDepth = strtol( eq, 0, 10 );
 				else if ( strcmp( arg, "state-limit" ) == 0 )
 					stateLimit = strtol( eq, 0, 10 );
+				else if ( strcmp( arg, "nfa-fallback" ) == 0 ) {
+					nfaFallback = eq != 0 ? strtol( eq, 0, 10 ) : 10;
+					if ( nfaFallback <= 0 )
+						error() << "invalid growth factor for --nfa-fallback" << endl;
+				}
+				else if ( strcmp( arg, "lazy-dfa" ) == 0 ) {
+					lazyDfa = true;
+					if ( eq != 0 )
+						lazyDfaCache = strtol( eq, 0, 10 );
+				}
 
 				else if ( strcmp( arg, "breadth-check" ) == 0 ) {
 					char *ptr = 0;
@@ -1009,6 +1154,24 @@ void InputData::parseArgs( int argc, const char **argv )
 					histogramFn = strdup(eq);
 				else if ( strcmp( arg, "var-backend" ) == 0 )
 					forceVar = true;
+				else if ( strcmp( arg, "eytzinger-search" ) == 0 )
+					eytzingerSearch = true;
+				else if ( strcmp( arg, "nfa-memo" ) == 0 )
+					nfaMemo = true;
+				else if ( strcmp( arg, "keyword-hash" ) == 0 )
+					codeStyle = GenKeywordHash;
+				else if ( strcmp( arg, "utf8" ) == 0 )
+					utf8Input = true;
+				else if ( strcmp( arg, "hybrid-threshold" ) == 0 ) {
+					hybridThreshold = eq != 0 ? strtod( eq, 0 ) : -1;
+					if ( hybridThreshold < 0 )
+						error() << "invalid percentage for --hybrid-threshold" << endl;
+				}
+				else if ( strcmp( arg, "asm-unroll" ) == 0 ) {
+					asmUnroll = eq != 0 ? strtol( eq, 0, 10 ) : 4;
+					if ( asmUnroll <= 0 )
+						error() << "invalid block size for --asm-unroll" << endl;
+				}
 				else if ( strcmp( arg, "no-fork" ) == 0 )
 					noFork = true;
 				else {
@@ -1025,6 +1188,10 @@ void InputData::parseArgs( int argc, const char **argv )
 					codeStyle = GenBinaryLoop;
 				else if ( pc.paramArg[0] == '1' )
 					codeStyle = GenBinaryExp;
+				else if ( pc.paramArg[0] == '2' )
+					codeStyle = GenBinaryThr;
+				else if ( pc.paramArg[0] == '3' )
+					codeStyle = GenBinaryHyb;
 				else {
 					error() << "-T" << pc.paramArg[0] << 
 							" is an invalid argument" << endl;
@@ -1036,6 +1203,10 @@ void InputData::parseArgs( int argc, const char **argv )
 					codeStyle = GenFlatLoop;
 				else if ( pc.paramArg[0] == '1' )
 					codeStyle = GenFlatExp;
+				else if ( pc.paramArg[0] == '2' )
+					codeStyle = GenFlatThr;
+				else if ( pc.paramArg[0] == '3' )
+					codeStyle = GenFlatHyb;
 				else {
 					error() << "-F" << pc.paramArg[0] << 
 							" is an invalid argument" << endl;
@@ -1169,12 +1340,57 @@ void InputData::checkArgs()
 	if ( !frontendSpecified )
 		frontend = ReduceBased;
 
-	if ( checkBreadth ) {
-		if ( histogramFn != 0 )
-			loadHistogram();
-		else
-			defaultHistogram();
+	if ( lazyDfa && stateLimit <= 0 )
+		error() << "--lazy-dfa requires --state-limit" << endp;
+
+	if ( lazyDfa && lazyDfaCache <= 0 )
+		error() << "invalid cache size for --lazy-dfa" << endp;
+
+	if ( blobTables && hostLang->backend != Direct )
+		error() << "--blob-tables is only supported for C" << endp;
+
+	if ( shareTables && hostLang->backend != Direct )
+		error() << "--share-tables is only supported for C" << endp;
+
+	if ( matchIds && ( hostLang->backend != Direct || hostLang == &hostLangAsm ) )
+		error() << "--match-ids is only supported for C" << endp;
+
+	if ( matchIds && lazyDfa )
+		error() << "--match-ids cannot be used with --lazy-dfa" << endp;
+
+	if ( counterReps > 0 && ( hostLang->backend != Direct || hostLang == &hostLangAsm ) )
+		error() << "--counter-reps is only supported for C" << endp;
+
+	if ( checkpoints > 0 && ( hostLang->backend != Direct || hostLang == &hostLangAsm ) )
+		error() << "--checkpoints is only supported for C" << endp;
+
+	if ( checkpoints > 0 && forceVar )
+		error() << "--checkpoints cannot be used with --var-backend" << endp;
+
+	if ( asmUnroll > 0 && hostLang != &hostLangAsm )
+		error() << "--asm-unroll is only supported for --asm" << endp;
+
+	if ( utf8Input ) {
+		if ( hostLang->backend != Direct )
+			error() << "--utf8 is only supported for C" << endp;
+
+		if ( codeStyle != GenBinaryLoop && codeStyle != GenBinaryExp &&
+				codeStyle != GenBinaryHyb && codeStyle != GenFlatLoop &&
+				codeStyle != GenFlatExp && codeStyle != GenFlatHyb )
+			error() << "--utf8 requires one of -T0, -T1, -T3, -F0, -F1 or -F3" << endp;
+
+		if ( lazyDfa )
+			error() << "--utf8 cannot be used with --lazy-dfa" << endp;
+
+		if ( forceVar )
+			error() << "--utf8 cannot be used with --var-backend" << endp;
 	}
+
+	/* The NFA fallback weighs its choices by breadth cost. */
+	if ( histogramFn != 0 )
+		loadHistogram();
+	else if ( checkBreadth || nfaFallback > 0 )
+		defaultHistogram();
 }
 
 char *InputData::readInput( const char *inputFileName )
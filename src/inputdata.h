@@ -320,6 +320,7 @@ struct InputData
 	void prepareAllMachines();
 
 	void writeOutput( InputItem *ii );
+	void writeFused( InputItem *ii );
 	void writeLanguage( std::ostream &out );
 
 	bool checkLastRef( InputItem *ii );
@@ -47,8 +47,12 @@ void IpGoto::genAnalysis()
 	 * potential for fall-throughs. */
 	redFsm->depthFirstOrdering();
 
-	/* Choose default transitions and the single transition. */
-	redFsm->chooseDefaultSpan();
+	/* Choose default transitions and the single transition. With an input
+	 * histogram the hottest transition is preferred. */
+	if ( redFsm->histogram != 0 )
+		redFsm->chooseDefaultFreq();
+	else
+		redFsm->chooseDefaultSpan();
 		
 	/* Choose single. */
 	redFsm->moveSelectTransToSingle();
@@ -327,6 +331,12 @@ std::ostream &IpGoto::TRANS_GOTO( RedTransAp *trans )
 			out << "goto " << stLabel[cond->targ->id].reference() << ";";
 		}
 	}
+	else if ( trans->condTree() ) {
+		RedCondPair **outcomes = new RedCondPair*[trans->condFullSize()];
+		trans->condOutcomes( outcomes );
+		COND_TREE( trans, outcomes, 0, 0 );
+		delete[] outcomes;
+	}
 	else {
 		out << ck << " = 0;\n";
 		for ( GenCondSet::Iter csi = trans->condSpace->condSet; csi.lte(); csi++ ) {
@@ -347,6 +357,33 @@ std::ostream &IpGoto::TRANS_GOTO( RedTransAp *trans )
 	return out;
 }
 
+/* Test only the conditions that decide between the targets, in the order
+ * chosen by RedTransAp::condSplit. Each path evaluates a condition at most
+ * once. A key with no pair and no error pair falls through, as it does after
+ * the search. */
+void IpGoto::COND_TREE( RedTransAp *trans, RedCondPair **outcomes, long mask, long val )
+{
+	int pos = trans->condSplit( outcomes, mask, val );
+	if ( pos < 0 ) {
+		/* Decided, any key in the subspace gives the outcome. */
+		long k = 0;
+		while ( ( k & mask ) != val )
+			k++;
+		if ( outcomes[k] != 0 )
+			COND_GOTO( outcomes[k] ) << "\n";
+		return;
+	}
+
+	long bit = 1 << pos;
+	out << "if ( ";
+	CONDITION( out, trans->condSpace->condSet.data[pos] );
+	out << " ) {\n";
+	COND_TREE( trans, outcomes, mask | bit, val | bit );
+	out << "}\nelse {\n";
+	COND_TREE( trans, outcomes, mask | bit, val );
+	out << "}\n";
+}
+
 /* Emit the goto to take for a given transition. */
 std::ostream &IpGoto::COND_GOTO( RedCondPair *cond )
 {
@@ -421,6 +458,9 @@ void IpGoto::NFA_PUSH_ST( RedStateAp *state )
 
 			int alt = 0;
 			for ( RedNfaTargs::Iter nt = *state->nfaTargs; nt.lte(); nt++ ) {
+				if ( redFsm->bNfaMemo )
+					NFA_MEMO_TEST( STR( nt->state->id ) );
+
 				out <<
 					"	nfa_bp[nfa_len].state = " << nt->state->id << ";\n"
 					"	nfa_bp[nfa_len].p = " << P() << ";\n";
@@ -442,6 +482,9 @@ void IpGoto::NFA_PUSH_ST( RedStateAp *state )
 				out <<
 					"	nfa_len += 1;\n";
 
+				if ( redFsm->bNfaMemo )
+					out << "			}}\n";
+
 				alt += 1;
 			}
 
@@ -451,6 +494,38 @@ void IpGoto::NFA_PUSH_ST( RedStateAp *state )
 	}
 }
 
+/* Test the ranges of the hot transition, which is also the state's default.
+ * When writing C directly the branch is marked as the likely one. */
+void IpGoto::HOT_RANGE_TEST( RedStateAp *st )
+{
+	ostringstream test;
+	for ( RedTransList::Iter rtel = st->hotRange; rtel.lte(); rtel++ ) {
+		if ( rtel.pos() > 0 )
+			test << " || ";
+
+		bool testLow = keyOps->gt( rtel->lowKey, keyOps->minKey );
+		bool testHigh = keyOps->lt( rtel->highKey, keyOps->maxKey );
+
+		if ( keyOps->eq( rtel->lowKey, rtel->highKey ) )
+			test << "( " << GET_KEY() << " == " << KEY( rtel->lowKey ) << " )";
+		else if ( testLow && testHigh ) {
+			test << "( " << KEY( rtel->lowKey ) << " <= " << GET_KEY() << " && " <<
+					GET_KEY() << " <= " << KEY( rtel->highKey ) << " )";
+		}
+		else if ( testLow )
+			test << "( " << KEY( rtel->lowKey ) << " <= " << GET_KEY() << " )";
+		else
+			test << "( " << GET_KEY() << " <= " << KEY( rtel->highKey ) << " )";
+	}
+
+	if ( backend == Direct )
+		out << "if ( __builtin_expect( " << test.str() << ", 1 ) ) {\n";
+	else
+		out << "if ( " << test.str() << " ) {\n";
+
+	TRANS_GOTO( st->defTrans ) << "\n}\n";
+}
+
 std::ostream &IpGoto::STATE_GOTOS()
 {
 	bool eof = redFsm->anyEofActivity() || redFsm->anyNfaStates();
@@ -549,6 +624,10 @@ std::ostream &IpGoto::STATE_GOTOS()
 			if ( st->anyRegCurStateRef() )
 				out << ps << " = " << st->id << ";\n";
 
+			/* Test for the hot transition before searching. */
+			if ( st->hotRange.length() > 0 )
+				HOT_RANGE_TEST( st );
+
 			/* Try singles. */
 			if ( st->outSingle.length() > 0 )
 				SINGLE_SWITCH( st );
@@ -688,6 +767,8 @@ void IpGoto::writeExec()
 
 	out << "{\n";
 
+	NFA_MEMO_DECLARE();
+
 	DECLARE( INT(), cpc );
 	DECLARE( INT(), ck );
 	DECLARE( INT(), pop_test );
@@ -696,6 +777,9 @@ void IpGoto::writeExec()
 	DECLARE( INT(), new_recs );
 	DECLARE( INT(), alt );
 
+	NFA_MEMO_INIT();
+	STATE_LOAD();
+
 	if ( _again.isReferenced ) {
 		out << 
 			"	goto " << _resume << ";\n"
@@ -760,6 +844,8 @@ void IpGoto::writeExec()
 
 	out << EMIT_LABEL( _out );
 
+	STATE_STORE();
+
 	out <<
 		"}\n";
 }
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "keyhash.h"
+#include "redfsm.h"
+#include "gendata.h"
+#include "parsedata.h"
+#include "inputdata.h"
+
+#include <sstream>
+#include <string.h>
+
+using std::ostringstream;
+using std::endl;
+
+/* Limits on what is considered a keyword machine. */
+static const int maxKeywords = 4096;
+static const int maxKeywordLen = 64;
+
+/* FNV-1a, seeded. The generated code computes the same. */
+static unsigned int kwHash( unsigned int seed, const Vector<Key> &keys )
+{
+	unsigned int h = 2166136261u ^ seed;
+	for ( int i = 0; i < keys.length(); i++ )
+		h = ( h ^ (unsigned char)keys[i].getVal() ) * 16777619u;
+	return h;
+}
+
+KeywordHash::~KeywordHash()
+{
+	delete[] disp;
+	delete[] slots;
+}
+
+/* Actions may not move p or the current state, nor leave the machine. */
+bool KeywordHash::plainActions( GenInlineList *inlineList )
+{
+	for ( GenInlineList::Iter item = *inlineList; item.lte(); item++ ) {
+		if ( item->type == GenInlineItem::Hold || item->type == GenInlineItem::Exec ||
+				item->type == GenInlineItem::LmHold )
+			return false;
+
+		if ( item->children != 0 && !plainActions( item->children ) )
+			return false;
+	}
+	return true;
+}
+
+bool KeywordHash::qualifies()
+{
+	if ( backend != Direct || alphType->size != 1 || red->getKeyExpr != 0 )
+		return false;
+
+	if ( redFsm->anyToStateActions() || redFsm->anyFromStateActions() ||
+			redFsm->anyEofActivity() || redFsm->anyNfaStates() ||
+			redFsm->anyActionGotos() || redFsm->anyActionCalls() ||
+			redFsm->anyActionRets() || redFsm->anyActionByValControl() ||
+			redFsm->anyRegNextStmt() || redFsm->anyRegCurStateRef() ||
+			redFsm->anyRegBreak() || redFsm->anyRegNbreak() || redFsm->bUsingAct )
+		return false;
+
+	for ( RedKeywordList::Iter w = words; w.lte(); w++ ) {
+		for ( RedKeywordActs::Iter a = w->acts; a.lte(); a++ ) {
+			for ( GenActionTable::Iter item = a->action->key; item.lte(); item++ ) {
+				if ( !plainActions( item->value->inlineList ) )
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* Hash and displace. Words are split into buckets by a first hash, then each
+ * bucket, largest first, gets the smallest seed that puts all its words into
+ * free slots. */
+bool KeywordHash::buildHash()
+{
+	int numWords = words.length();
+
+	numBuckets = ( numWords + 3 ) / 4;
+	numSlots = 1;
+	while ( numSlots < numWords + numWords / 4 )
+		numSlots *= 2;
+
+	disp = new unsigned int[numBuckets];
+	slots = new int[numSlots];
+	memset( disp, 0, sizeof(unsigned int) * numBuckets );
+	memset( slots, 0, sizeof(int) * numSlots );
+
+	int *bucket = new int[numWords];
+	int *bucketSize = new int[numBuckets];
+	memset( bucketSize, 0, sizeof(int) * numBuckets );
+	int maxBucket = 0;
+	for ( int w = 0; w < numWords; w++ ) {
+		bucket[w] = kwHash( 0, words[w].keys ) % numBuckets;
+		bucketSize[bucket[w]] += 1;
+		if ( bucketSize[bucket[w]] > maxBucket )
+			maxBucket = bucketSize[bucket[w]];
+	}
+
+	bool success = true;
+	int *tried = new int[maxBucket];
+	for ( int size = maxBucket; size > 0 && success; size-- ) {
+		for ( int b = 0; b < numBuckets && success; b++ ) {
+			if ( bucketSize[b] != size )
+				continue;
+
+			unsigned int d = 1;
+			for ( ; d < 1000000; d++ ) {
+				int n = 0;
+				for ( int w = 0; w < numWords; w++ ) {
+					if ( bucket[w] != b )
+						continue;
+
+					int slot = kwHash( d, words[w].keys ) & ( numSlots - 1 );
+					bool taken = slots[slot] != 0;
+					for ( int i = 0; i < n && !taken; i++ )
+						taken = tried[i] == slot;
+					if ( taken )
+						break;
+					tried[n++] = slot;
+				}
+
+				if ( n == size )
+					break;
+			}
+
+			if ( d == 1000000 ) {
+				success = false;
+				break;
+			}
+
+			disp[b] = d;
+			for ( int w = 0; w < numWords; w++ ) {
+				if ( bucket[w] == b )
+					slots[kwHash( d, words[w].keys ) & ( numSlots - 1 )] = w + 1;
+			}
+		}
+	}
+
+	delete[] tried;
+	delete[] bucketSize;
+	delete[] bucket;
+	return success;
+}
+
+void KeywordHash::genAnalysis()
+{
+	/* Collect the words before the base analysis picks defaults. */
+	useHash = redFsm->keywordSet( words, maxKeywords, maxKeywordLen ) &&
+			words.length() > 0;
+
+	BinGotoLoop::genAnalysis();
+
+	if ( useHash )
+		useHash = qualifies() && buildHash();
+
+	if ( useHash ) {
+		minLen = maxLen = words[0].keys.length();
+		for ( RedKeywordList::Iter w = words; w.lte(); w++ ) {
+			if ( w->keys.length() < minLen )
+				minLen = w->keys.length();
+			if ( w->keys.length() > maxLen )
+				maxLen = w->keys.length();
+		}
+	}
+
+	if ( red->id->printStatistics ) {
+		red->id->stats() << "keyword-hash\t" << ( useHash ? words.length() : 0 ) <<
+				"\t" << numSlots << endl;
+	}
+}
+
+void KeywordHash::writeData()
+{
+	BinGotoLoop::writeData();
+
+	if ( !useHash )
+		return;
+
+	string prefix = "_" + DATA_PREFIX();
+
+	out << "static const unsigned int " << prefix << "kw_disp[] = {";
+	for ( int b = 0; b < numBuckets; b++ )
+		out << ( b % 8 == 0 ? "\n\t" : " " ) << disp[b] << "u,";
+	out << "\n};\n\n";
+
+	out << "static const int " << prefix << "kw_slot[] = {";
+	for ( int s = 0; s < numSlots; s++ )
+		out << ( s % 8 == 0 ? "\n\t" : " " ) << slots[s] << ",";
+	out << "\n};\n\n";
+
+	out << "static const int " << prefix << "kw_targ[] = {";
+	for ( int w = 0; w < words.length(); w++ )
+		out << ( w % 8 == 0 ? "\n\t" : " " ) << words[w].targ->id << ",";
+	out << "\n};\n\n";
+
+	out << "static const unsigned int " << prefix << "kw_len[] = {";
+	for ( int w = 0; w < words.length(); w++ )
+		out << ( w % 8 == 0 ? "\n\t" : " " ) << words[w].keys.length() << "u,";
+	out << "\n};\n\n";
+
+	out << "static const unsigned int " << prefix << "kw_off[] = {";
+	int off = 0;
+	for ( int w = 0; w < words.length(); w++ ) {
+		out << ( w % 8 == 0 ? "\n\t" : " " ) << off << "u,";
+		off += words[w].keys.length();
+	}
+	out << "\n};\n\n";
+
+	/* All the keywords, back to back, as octal escapes. */
+	out << "static const char " << prefix << "kw_str[] =";
+	for ( int w = 0; w < words.length(); w++ ) {
+		out << "\n\t\"";
+		for ( int i = 0; i < words[w].keys.length(); i++ ) {
+			unsigned int c = (unsigned char)words[w].keys[i].getVal();
+			out << "\\" << ( c >> 6 ) << ( ( c >> 3 ) & 7 ) << ( c & 7 );
+		}
+		out << "\"";
+	}
+	out << ";\n\n";
+}
+
+void KeywordHash::writeExec()
+{
+	if ( !useHash ) {
+		BinGotoLoop::writeExec();
+		return;
+	}
+
+	string prefix = "_" + DATA_PREFIX();
+	string len = "(unsigned int)(" + PE() + " - " + P() + ")";
+
+	out <<
+		"	{\n"
+		"	int _kw = 0;\n"
+		"	if ( " << vCS() << " == " << START_STATE_ID() << " && " <<
+				len << " >= " << minLen << "u && " << len << " <= " << maxLen << "u ) {\n"
+		"		unsigned int _h = 2166136261u, _i;\n"
+		"		int _w;\n"
+		"		for ( _i = 0; _i < " << len << "; _i++ )\n"
+		"			_h = ( _h ^ (unsigned char)" << P() << "[_i] ) * 16777619u;\n"
+		"		_h = 2166136261u ^ " << prefix << "kw_disp[_h % " << numBuckets << "u];\n"
+		"		for ( _i = 0; _i < " << len << "; _i++ )\n"
+		"			_h = ( _h ^ (unsigned char)" << P() << "[_i] ) * 16777619u;\n"
+		"		_w = " << prefix << "kw_slot[_h & " << ( numSlots - 1 ) << "u];\n"
+		"		if ( _w != 0 && " << prefix << "kw_len[_w - 1] == " << len << " &&\n"
+		"				memcmp( " << prefix << "kw_str + " << prefix << "kw_off[_w - 1], " <<
+						P() << ", " << len << " ) == 0 )\n"
+		"		{\n";
+
+	/* Run the actions of the path, with p where the byte-wise machine would
+	 * have it. */
+	bool anyActs = false;
+	for ( RedKeywordList::Iter w = words; w.lte(); w++ ) {
+		if ( w->acts.length() > 0 )
+			anyActs = true;
+	}
+
+	if ( anyActs ) {
+		out << "			switch ( _w ) {\n";
+		for ( RedKeywordList::Iter w = words; w.lte(); w++ ) {
+			if ( w->acts.length() == 0 )
+				continue;
+
+			out << "			case " << w.pos() + 1 << ": {\n";
+			int pos = 0;
+			for ( RedKeywordActs::Iter a = w->acts; a.lte(); a++ ) {
+				if ( a->pos != pos )
+					out << "			" << P() << " += " << a->pos - pos << ";\n";
+				pos = a->pos;
+
+				for ( GenActionTable::Iter item = a->action->key; item.lte(); item++ ) {
+					ACTION( out, item->value, IlOpts( w->targ->id, false, false ) );
+					out << "\n";
+				}
+			}
+			out << "			break; }\n";
+		}
+		out << "			}\n";
+	}
+
+	out <<
+		"			" << vCS() << " = " << prefix << "kw_targ[_w - 1];\n"
+		"			" << P() << " = " << PE() << ";\n"
+		"			_kw = 1;\n"
+		"		}\n"
+		"	}\n"
+		"	if ( _kw == 0 )\n";
+
+	BinGotoLoop::writeExec();
+
+	out << "	}\n";
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _KEYHASH_H
+#define _KEYHASH_H
+
+#include "bingoto.h"
+
+/*
+ * Keyword classification by perfect hash. When the machine accepts a small,
+ * finite set of strings and its actions are plain, exec first hashes the
+ * whole of p .. pe and compares against the matching keyword, running the
+ * actions of its path directly. Anything else goes through the regular binary
+ * search machine. Only for C, and only if the machine qualifies.
+ */
+class KeywordHash
+	: public BinGotoLoop
+{
+public:
+	KeywordHash( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		BinGotoLoop( args ),
+		useHash( false ),
+		numBuckets( 0 ),
+		numSlots( 0 ),
+		disp( 0 ),
+		slots( 0 )
+	{}
+
+	~KeywordHash();
+
+	virtual void genAnalysis();
+	virtual void writeData();
+	virtual void writeExec();
+
+private:
+	bool qualifies();
+	bool plainActions( GenInlineList *inlineList );
+	bool buildHash();
+
+	RedKeywordList words;
+	bool useHash;
+	int minLen;
+	int maxLen;
+
+	int numBuckets;
+	int numSlots;
+	unsigned int *disp;
+	int *slots;
+};
+
+#endif
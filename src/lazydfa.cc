@@ -0,0 +1,357 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "lazydfa.h"
+#include "redfsm.h"
+#include "gendata.h"
+#include "parsedata.h"
+#include "inputdata.h"
+
+#include <sstream>
+#include <string.h>
+
+using std::ostringstream;
+using std::endl;
+
+LazyDfa::~LazyDfa()
+{
+	delete[] charClass;
+	delete[] targs;
+}
+
+/* The NFA must come straight from the lazy walk: only the start state has NFA
+ * transitions, and nothing but the states says what is accepted. */
+void LazyDfa::checkMachine()
+{
+	if ( backend != Direct || alphType->size != 1 ) {
+		red->id->error() << "the lazy DFA runtime requires C and a one byte "
+				"alphabet" << endp;
+	}
+
+	RedStateAp *start = redFsm->startState;
+	bool plain = start != 0 && start->nfaTargs != 0 && start->outRange.length() == 0 &&
+			redFsm->actionMap.length() == 0 && red->condSpaceList.length() == 0;
+
+	for ( RedStateList::Iter st = redFsm->stateList; plain && st.lte(); st++ ) {
+		if ( st != start && st->nfaTargs != 0 )
+			plain = false;
+	}
+
+	if ( !plain ) {
+		red->id->error() << "the lazy DFA runtime requires a union of "
+				"alternatives without actions or conditions" << endp;
+	}
+}
+
+/* Read the tables off the ranges, before the defaults are chosen. */
+void LazyDfa::makeTables()
+{
+	EquivList equiv;
+	redFsm->characterClass( equiv );
+
+	/* One more class for the characters no state has a transition on. */
+	long long low = redFsm->lowKey.getVal();
+	numClasses = redFsm->nextClass + 1;
+	charClass = new int[256];
+	for ( int u = 0; u < 256; u++ ) {
+		long long v = alphType->isSigned ? (long long)(signed char)u : u;
+		if ( redFsm->classMap != 0 && v >= low && v <= redFsm->highKey.getVal() )
+			charClass[u] = redFsm->classMap[v - low];
+		else
+			charClass[u] = numClasses - 1;
+	}
+
+	numStates = redFsm->nextStateId;
+	targs = new int[numStates * numClasses];
+	for ( int i = 0; i < numStates * numClasses; i++ )
+		targs[i] = -1;
+
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			RedStateAp *targ = rtel->value->outCond( 0 )->targ;
+			if ( targ == 0 || targ == redFsm->errState )
+				continue;
+
+			for ( long long v = rtel->lowKey.getVal(); v <= rtel->highKey.getVal(); v++ )
+				targs[st->id * numClasses + redFsm->classMap[v - low]] = targ->id;
+		}
+	}
+
+	/* The start set, sorted. The alternatives are DFAs, so no set built from
+	 * it can be larger. */
+	for ( RedNfaTargs::Iter s = *redFsm->startState->nfaTargs; s.lte(); s++ ) {
+		int id = s->state->id, pos = 0;
+		while ( pos < startSet.length() && startSet[pos] < id )
+			pos += 1;
+		if ( pos == startSet.length() || startSet[pos] != id )
+			startSet.insert( pos, id );
+	}
+
+	cacheStates = red->id->lazyDfaCache;
+
+	/* Between calls cs says whether the set exec stopped in is final, using a
+	 * state other than the start state, which means exec has not run yet. The
+	 * sets only hold alternative states, so if there is no such state of a
+	 * kind, no set of that kind can occur. */
+	resumeFinal = resumeNonFinal = redFsm->startState->id;
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ ) {
+		if ( st == redFsm->startState || st == redFsm->errState )
+			continue;
+		if ( st->isFinal && resumeFinal == redFsm->startState->id )
+			resumeFinal = st->id;
+		if ( !st->isFinal && resumeNonFinal == redFsm->startState->id )
+			resumeNonFinal = st->id;
+	}
+}
+
+void LazyDfa::genAnalysis()
+{
+	checkMachine();
+	makeTables();
+
+	BinGotoLoop::genAnalysis();
+
+	if ( red->id->printStatistics ) {
+		red->id->stats() << "lazy-dfa-classes\t" << numClasses << endl;
+		red->id->stats() << "lazy-dfa-nfa-states\t" << numStates << endl;
+		red->id->stats() << "lazy-dfa-cache\t" << cacheStates << endl;
+	}
+}
+
+void LazyDfa::writeInts( const char *type, const char *name, const int *data, int len )
+{
+	out << "static const " << type << " _" << DATA_PREFIX() << name << "[] = {";
+	for ( int i = 0; i < len; i++ )
+		out << ( i % 16 == 0 ? "\n\t" : " " ) << data[i] << ",";
+	out << "\n};\n\n";
+}
+
+void LazyDfa::writeData()
+{
+	STATE_IDS();
+
+	string prefix = "_" + DATA_PREFIX();
+	int setLen = startSet.length();
+
+	writeInts( numClasses <= 256 ? "unsigned char" : "unsigned short",
+			"lz_class", charClass, 256 );
+	writeInts( "int", "lz_targ", targs, numStates * numClasses );
+	writeInts( "int", "lz_start", startSet.data, setLen );
+
+	int *final = new int[numStates];
+	memset( final, 0, sizeof(int) * numStates );
+	for ( RedStateList::Iter st = redFsm->stateList; st.lte(); st++ )
+		final[st->id] = st->isFinal ? 1 : 0;
+	writeInts( "char", "lz_final", final, numStates );
+	delete[] final;
+
+	/* The cache, declared by the host as lz_cache and shared by the streams
+	 * of one thread. Sets of alternative states, their successors by class,
+	 * plus 1, and a hash from sets to cache entries, plus 1. It must start
+	 * out zeroed. */
+	out <<
+		"struct " << DATA_PREFIX() << "lz_cache\n"
+		"{\n"
+		"	int used;\n"
+		"	int flushes;\n"
+		"	int next[" << cacheStates * numClasses << "];\n"
+		"	int set[" << cacheStates * setLen << "];\n"
+		"	int len[" << cacheStates << "];\n"
+		"	char fin[" << cacheStates << "];\n"
+		"	int hash[" << cacheStates * 2 << "];\n"
+		"	int tmp[" << setLen << "];\n"
+		"};\n"
+		"\n";
+
+	/* Where one stream stopped, declared by the host as lz_resume unless
+	 * write state holds it. */
+	out <<
+		"struct " << DATA_PREFIX() << "lz_resume\n"
+		"{\n"
+		"	int len;\n"
+		"	int set[" << setLen << "];\n"
+		"};\n"
+		"\n";
+
+	/* Find a set in the cache, or add it. When the cache is full it is
+	 * emptied and started over. */
+	out <<
+		"static int " << prefix << "lz_add( struct " << DATA_PREFIX() << "lz_cache *lz, "
+				"const int *set, int len )\n"
+		"{\n"
+		"	unsigned int h = 2166136261u;\n"
+		"	int i, j, s;\n"
+		"	for ( i = 0; i < len; i++ )\n"
+		"		h = ( h ^ (unsigned int)set[i] ) * 16777619u;\n"
+		"	for ( i = h % " << cacheStates * 2 << "u; lz->hash[i] != 0; "
+				"i = ( i + 1 ) % " << cacheStates * 2 << " ) {\n"
+		"		s = lz->hash[i] - 1;\n"
+		"		if ( lz->len[s] == len && memcmp( lz->set + s * " <<
+					setLen << ", set, len * sizeof(int) ) == 0 )\n"
+		"			return s;\n"
+		"	}\n"
+		"	if ( lz->used == " << cacheStates << " ) {\n"
+		"		lz->used = 0;\n"
+		"		lz->flushes += 1;\n"
+		"		memset( lz->hash, 0, sizeof(lz->hash) );\n"
+		"		memset( lz->next, 0, sizeof(lz->next) );\n"
+		"		i = h % " << cacheStates * 2 << "u;\n"
+		"	}\n"
+		"	s = lz->used++;\n"
+		"	memcpy( lz->set + s * " << setLen << ", set, len * sizeof(int) );\n"
+		"	lz->len[s] = len;\n"
+		"	lz->fin[s] = 0;\n"
+		"	for ( j = 0; j < len; j++ ) {\n"
+		"		if ( " << prefix << "lz_final[set[j]] )\n"
+		"			lz->fin[s] = 1;\n"
+		"	}\n"
+		"	lz->hash[i] = s + 1;\n"
+		"	return s;\n"
+		"}\n"
+		"\n";
+
+	/* Move every state of the set on the class, keeping the result sorted. */
+	out <<
+		"static int " << prefix << "lz_step( struct " << DATA_PREFIX() << "lz_cache *lz, "
+				"int cur, int c )\n"
+		"{\n"
+		"	int n = 0, i, j, t, nx, flushes = lz->flushes;\n"
+		"	const int *set = lz->set + cur * " << setLen << ";\n"
+		"	for ( i = 0; i < lz->len[cur]; i++ ) {\n"
+		"		t = " << prefix << "lz_targ[set[i] * " << numClasses << " + c];\n"
+		"		if ( t < 0 )\n"
+		"			continue;\n"
+		"		for ( j = n; j > 0 && lz->tmp[j - 1] > t; j-- )\n"
+		"			;\n"
+		"		if ( j > 0 && lz->tmp[j - 1] == t )\n"
+		"			continue;\n"
+		"		memmove( lz->tmp + j + 1, lz->tmp + j, ( n - j ) * sizeof(int) );\n"
+		"		lz->tmp[j] = t;\n"
+		"		n += 1;\n"
+		"	}\n"
+		"	nx = " << prefix << "lz_add( lz, lz->tmp, n );\n"
+		"	if ( lz->flushes == flushes )\n"
+		"		lz->next[cur * " << numClasses << " + c] = nx + 1;\n"
+		"	return nx;\n"
+		"}\n"
+		"\n";
+}
+
+string LazyDfa::LZ_CACHE()
+{
+	ostringstream ret;
+	if ( red->lzCacheExpr == 0 )
+		ret << "lz_cache";
+	else {
+		ret << OPEN_HOST_EXPR();
+		INLINE_LIST( ret, red->lzCacheExpr, 0, false, false );
+		ret << CLOSE_HOST_EXPR();
+	}
+	return ret.str();
+}
+
+/* The set a stream stopped in, in the state struct or in lz_resume. */
+string LazyDfa::RESUME( const char *field )
+{
+	ostringstream ret;
+	if ( stateStruct )
+		ret << ACCESS() << "lz_" << field;
+	else if ( red->lzResumeExpr == 0 )
+		ret << ACCESS() << "lz_resume." << field;
+	else {
+		ret << OPEN_HOST_EXPR();
+		INLINE_LIST( ret, red->lzResumeExpr, 0, false, false );
+		ret << CLOSE_HOST_EXPR() << "." << field;
+	}
+	return ret.str();
+}
+
+/* Exec continues from the set the previous call stopped in. The set is kept
+ * outside the cache, which may be flushed in between, and is copied through
+ * tmp since the state struct packs it into narrower types. */
+void LazyDfa::writeExec()
+{
+	string prefix = "_" + DATA_PREFIX();
+
+	out <<
+		"	if ( " << vCS() << " != " << ERROR_STATE() << " ) {\n"
+		"	int _lz_c, _lz_nx, _lz_cur, _lz_i;\n"
+		"	struct " << DATA_PREFIX() << "lz_cache *_lz = &" << LZ_CACHE() << ";\n"
+		"	if ( " << vCS() << " == " << START_STATE_ID() << " )\n"
+		"		_lz_cur = " << prefix << "lz_add( _lz, " << prefix << "lz_start, " <<
+				startSet.length() << " );\n"
+		"	else {\n"
+		"		for ( _lz_i = 0; _lz_i < " << RESUME( "len" ) << "; _lz_i++ )\n"
+		"			_lz->tmp[_lz_i] = " << RESUME( "set" ) << "[_lz_i];\n"
+		"		_lz_cur = " << prefix << "lz_add( _lz, _lz->tmp, " << RESUME( "len" ) << " );\n"
+		"	}\n"
+		"	while ( " << P() << " != " << PE() << " ) {\n"
+		"		_lz_c = " << prefix << "lz_class[(unsigned char)" << GET_KEY() << "];\n"
+		"		_lz_nx = _lz->next[_lz_cur * " << numClasses << " + _lz_c] - 1;\n"
+		"		if ( _lz_nx < 0 )\n"
+		"			_lz_nx = " << prefix << "lz_step( _lz, _lz_cur, _lz_c );\n"
+		"		_lz_cur = _lz_nx;\n"
+		"		if ( _lz->len[_lz_cur] == 0 )\n"
+		"			break;\n"
+		"		" << P() << " += 1;\n"
+		"	}\n"
+		"	" << RESUME( "len" ) << " = _lz->len[_lz_cur];\n"
+		"	for ( _lz_i = 0; _lz_i < _lz->len[_lz_cur]; _lz_i++ )\n"
+		"		" << RESUME( "set" ) << "[_lz_i] = _lz->set[_lz_cur * " <<
+				startSet.length() << " + _lz_i];\n"
+		"	if ( _lz->len[_lz_cur] == 0 )\n"
+		"		" << vCS() << " = " << ERROR_STATE() << ";\n"
+		"	else if ( _lz->fin[_lz_cur] )\n"
+		"		" << vCS() << " = " << resumeFinal << ";\n"
+		"	else\n"
+		"		" << vCS() << " = " << resumeNonFinal << ";\n"
+		"	}\n";
+}
+
+/* The state of one stream: cs and the set it stopped in. The cache is not
+ * part of it. */
+void LazyDfa::writeState( InputLoc &loc, long )
+{
+	if ( red->accessExpr == 0 ) {
+		red->id->error(loc) << "write state requires an access statement" << endl;
+		return;
+	}
+
+	if ( red->csExpr != 0 || red->lzResumeExpr != 0 ) {
+		red->id->error(loc) << "write state cannot be used with variable "
+				"cs or lz_resume" << endl;
+		return;
+	}
+
+	const char *csType = fittingType( redFsm->nextStateId );
+
+	out <<
+		"struct " << DATA_PREFIX() << "state\n"
+		"{\n"
+		"	" << csType << " cs;\n"
+		"	" << fittingType( startSet.length() ) << " lz_len;\n"
+		"	" << csType << " lz_set[" << startSet.length() << "];\n"
+		"};\n"
+		"\n";
+
+	stateStruct = true;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LAZYDFA_H
+#define _LAZYDFA_H
+
+#include "bingoto.h"
+
+/*
+ * Runtime for machines that were too large to make deterministic. The
+ * alternatives of the top-level union are written as flat tables over
+ * character classes, and exec builds the DFA states it needs from sets of
+ * their states, into a cache of fixed size that is flushed when full. Only
+ * for C, and only for machines without actions or conditions.
+ */
+class LazyDfa
+	: public BinGotoLoop
+{
+public:
+	LazyDfa( const CodeGenArgs &args )
+	:
+		Tables( args ),
+		BinGotoLoop( args ),
+		numClasses( 0 ),
+		numStates( 0 ),
+		charClass( 0 ),
+		targs( 0 ),
+		cacheStates( 0 ),
+		resumeFinal( 0 ),
+		resumeNonFinal( 0 )
+	{}
+
+	~LazyDfa();
+
+	virtual void genAnalysis();
+	virtual void writeData();
+	virtual void writeExec();
+	virtual void writeState( InputLoc &loc, long stackSize );
+
+private:
+	std::string LZ_CACHE();
+	std::string RESUME( const char *field );
+
+	void checkMachine();
+	void makeTables();
+	void writeInts( const char *type, const char *name, const int *data, int len );
+
+	int numClasses;
+	int numStates;
+	int *charClass;
+	int *targs;
+	Vector<int> startSet;
+	int cacheStates;
+	int resumeFinal;
+	int resumeNonFinal;
+};
+
+#endif
@@ -195,12 +195,45 @@ Key makeFsmKeyChar( char c, ParseData *pd )
 	}
 }
 
+/* Decode the UTF-8 sequence at pos and move past it. A sequence that is not
+ * well formed is 0x110000, as the generated code reads it from the input. */
+static long utf8Key( const unsigned char *src, int len, int &pos )
+{
+	long c = src[pos++];
+	if ( c < 0x80 )
+		return c;
+
+	int more = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+	if ( more == 0 || c >= 0xf8 || pos + more > len )
+		return 0x110000;
+
+	long cp = c & ( 0x3f >> more );
+	int i = 0;
+	while ( i < more && ( src[pos + i] & 0xc0 ) == 0x80 ) {
+		cp = ( cp << 6 ) | ( src[pos + i] & 0x3f );
+		i += 1;
+	}
+	pos += i;
+
+	if ( i < more || cp < ( more == 1 ? 0x80 : more == 2 ? 0x800 : 0x10000 ) ||
+			( cp >= 0xd800 && cp <= 0xdfff ) || cp > 0x10ffff )
+		return 0x110000;
+	return cp;
+}
+
 /* Make an fsm key array in int format (what the fsm graph uses) from a string
  * of characters. Performs proper conversion depending on signed/unsigned
- * property of the alphabet. */
-void makeFsmKeyArray( Key *result, char *data, int len, ParseData *pd )
+ * property of the alphabet. With --utf8 the string is decoded into
+ * codepoints. Returns the number of keys. */
+int makeFsmKeyArray( Key *result, char *data, int len, ParseData *pd )
 {
-	if ( pd->fsmCtx->keyOps->isSigned ) {
+	if ( pd->id->utf8Input ) {
+		int n = 0;
+		for ( int pos = 0; pos < len; )
+			result[n++] = Key( utf8Key( (unsigned char*)data, len, pos ) );
+		return n;
+	}
+	else if ( pd->fsmCtx->keyOps->isSigned ) {
 		/* Copy from a char star type. */
 		char *src = data;
 		for ( int i = 0; i < len; i++ )
@@ -212,6 +245,7 @@ void makeFsmKeyArray( Key *result, char *data, int len, ParseData *pd )
 		for ( int i = 0; i < len; i++ )
 			result[i] = Key(src[i]);
 	}
+	return len;
 }
 
 /* Like makeFsmKeyArray except the result has only unique keys. They ordering
@@ -220,7 +254,20 @@ void makeFsmUniqueKeyArray( KeySet &result, const char *data, int len,
 		bool caseInsensitive, ParseData *pd )
 {
 	/* Use a transitions list for getting unique keys. */
-	if ( pd->fsmCtx->keyOps->isSigned ) {
+	if ( pd->id->utf8Input ) {
+		const unsigned char *src = (unsigned char*) data;
+		for ( int pos = 0; pos < len; ) {
+			Key key( utf8Key( src, len, pos ) );
+			result.insert( key );
+			if ( caseInsensitive ) {
+				if ( key.isLower() )
+					result.insert( key.toUpper() );
+				else if ( key.isUpper() )
+					result.insert( key.toLower() );
+			}
+		}
+	}
+	else if ( pd->fsmCtx->keyOps->isSigned ) {
 		/* Copy from a char star type. */
 		const char *src = data;
 		for ( int si = 0; si < len; si++ ) {
@@ -440,6 +487,13 @@ ParseData::ParseData( InputData *id, string sectionName,
 	nextEpsilonResolvedLink(0),
 	nextLongestMatchId(1),
 	nextRepId(1),
+	lazyDfa(false),
+	matchIdDef(0),
+	nfaFallbackDef(0),
+	counterReps(0),
+	repsExpr(0),
+	walkMemoHits(0),
+	walkMemoBuilds(0),
 	cgd(0)
 {
 	fsmCtx = new FsmCtx( id );
@@ -466,6 +520,12 @@ ParseData::~ParseData()
 	if ( exportsRootName != 0 )
 		delete exportsRootName;
 
+	for ( WalkMemo::Iter memoEl = walkMemo; memoEl.lte(); memoEl++ )
+		delete memoEl->value;
+
+	if ( repsExpr != 0 )
+		delete repsExpr;
+
 	delete fsmCtx;
 }
 
@@ -1009,18 +1069,81 @@ bool ParseData::setVariable( const char *var, InlineList *inlineList )
 		fsmCtx->tokstartExpr = inlineList;
 	else if ( strcmp( var, "te" ) == 0 )
 		fsmCtx->tokendExpr = inlineList;
+	else if ( strcmp( var, "reps" ) == 0 )
+		repsExpr = inlineList;
+	else if ( strcmp( var, "lz_cache" ) == 0 )
+		fsmCtx->lzCacheExpr = inlineList;
+	else if ( strcmp( var, "lz_resume" ) == 0 )
+		fsmCtx->lzResumeExpr = inlineList;
 	else
 		set = false;
 
 	return set;
 }
 
+/* The counter loops are made while walking, as actions of host text, so the
+ * name of their array is worked out here rather than by the code generator.
+ * It is the reps variable if one is set, otherwise reps behind the access
+ * prefix. */
+std::string ParseData::repsVar()
+{
+	InlineList *inlineList = repsExpr != 0 ? repsExpr : fsmCtx->accessExpr;
+
+	std::string name;
+	if ( inlineList != 0 ) {
+		for ( InlineList::Iter item = *inlineList; item.lte(); item++ ) {
+			if ( item->type != InlineItem::Text ) {
+				id->error(item->loc) << "the counter loops need plain host text "
+						"for " << ( repsExpr != 0 ? "variable reps" : "access" ) << endl;
+			}
+			name += item->data;
+		}
+	}
+
+	if ( repsExpr == 0 )
+		name += "reps";
+	return name;
+}
+
+/* A walk that built counter loops was thrown away. Its actions, and the
+ * condition spaces testing them, were used only by the discarded graph.
+ * Nothing else makes actions while walking. */
+void ParseData::dropCounterActions( Action *last )
+{
+	while ( fsmCtx->actionList.tail != last ) {
+		Action *action = fsmCtx->actionList.detachLast();
+
+		Vector<CondSpace*> spaces;
+		for ( CondSpaceMap::Iter cs = fsmCtx->condData->condSpaceMap; cs.lte(); cs++ ) {
+			if ( cs->condSet.find( action ) != 0 )
+				spaces.append( cs );
+		}
+
+		for ( Vector<CondSpace*>::Iter cs = spaces; cs.lte(); cs++ ) {
+			fsmCtx->condData->condSpaceMap.detach( *cs );
+			delete *cs;
+		}
+
+		delete action;
+	}
+}
+
 /* Initialize the key operators object that will be referenced by all fsms
  * created. */
 void ParseData::initKeyOps( const HostLang *hostLang )
 {
 	/* Signedness and bounds. */
 	alphType = alphTypeSet ? userAlphType : &hostLang->hostTypes[hostLang->defaultAlphType];
+
+	/* Codepoint machines need room for every codepoint and one more, which
+	 * stands for input that is not well formed. */
+	if ( id->utf8Input ) {
+		if ( !alphTypeSet )
+			alphType = findAlphType( hostLang, "unsigned", "int" );
+		else if ( alphType->size < 4 )
+			id->error(alphTypeLoc) << "--utf8 requires an alphtype of at least 32 bits" << endl;
+	}
+
 	fsmCtx->keyOps->setAlphType( hostLang, alphType );
 
 	if ( lowerNum != 0 ) {
@@ -1028,6 +1151,10 @@ void ParseData::initKeyOps( const HostLang *hostLang )
 		fsmCtx->keyOps->minKey = makeFsmKeyNum( lowerNum, rangeLowLoc, this );
 		fsmCtx->keyOps->maxKey = makeFsmKeyNum( upperNum, rangeHighLoc, this );
 	}
+	else if ( id->utf8Input ) {
+		fsmCtx->keyOps->minKey = 0;
+		fsmCtx->keyOps->maxKey = 0x110000;
+	}
 }
 
 void ParseData::printNameInst( std::ostream &out, NameInst *nameInst, int level )
@@ -1239,9 +1366,63 @@ FsmRes ParseData::makeInstance( GraphDictEl *gdNode )
 	if ( id->stateLimit > 0 )
 		fsmCtx->stateLimit = id->stateLimit;
 
+	NameInst *walkInst = curNameInst;
+	int walkChild = curNameChild;
+	int walkEpsilonLink = nextEpsilonResolvedLink;
+
+	/* The alternatives of the instance are numbered for match reporting. */
+	matchIdDef = id->matchIds ? gdNode->value : 0;
+	nfaFallbackDef = id->nfaFallback > 0 ? gdNode->value : 0;
+
+	/* Large repetitions may be built as counter loops. These only match the
+	 * same strings as the copies if their guarding priorities never meet
+	 * others, so watch for that. */
+	bool checkPriorInteraction = fsmCtx->checkPriorInteraction;
+	counterReps = id->counterReps;
+	if ( counterReps > 0 )
+		fsmCtx->checkPriorInteraction = true;
+
+	Action *lastAction = fsmCtx->actionList.tail;
+	int nextCounterRep = fsmCtx->nextCounterRep;
+
 	/* Build the graph from a walk of the parse tree. */
 	FsmRes graph = gdNode->value->walk( this );
 
+	counterReps = 0;
+	fsmCtx->checkPriorInteraction = checkPriorInteraction;
+
+	/* A counter loop overlaps with what surrounds it. Build it again from
+	 * copies. */
+	if ( graph.type == FsmRes::TypePriorInteraction && id->counterReps > 0 ) {
+		curNameInst = walkInst;
+		curNameChild = walkChild;
+		nextEpsilonResolvedLink = walkEpsilonLink;
+
+		dropCounterActions( lastAction );
+		fsmCtx->nextCounterRep = nextCounterRep;
+
+		graph = gdNode->value->walk( this );
+		if ( id->printStatistics )
+			id->stats() << "counter-reps-rebuilt\t" << sectionName << endl;
+	}
+
+	matchIdDef = 0;
+	nfaFallbackDef = 0;
+
+	/* Too many states, build it again for the lazy DFA runtime. */
+	if ( graph.type == FsmRes::TypeTooManyStates && id->lazyDfa ) {
+		curNameInst = walkInst;
+		curNameChild = walkChild;
+		nextEpsilonResolvedLink = walkEpsilonLink;
+
+		graph = gdNode->value->walkLazy( this );
+		if ( graph.success() ) {
+			lazyDfa = true;
+			if ( id->printStatistics )
+				id->stats() << "lazy-dfa\t" << graph.fsm->stateList.length() << endl;
+		}
+	}
+
 	if ( id->stateLimit > 0 )
 		fsmCtx->stateLimit = FsmCtx::STATE_UNLIMITED;
 
@@ -1431,10 +1612,25 @@ FsmRes ParseData::prepareMachineGen( GraphDictEl *graphDictEl, const HostLang *h
 		sectionGraph = res.fsm;
 	}
 	
+	if ( id->printStatistics ) {
+		id->stats() << "walk-memo-builds\t" << walkMemoBuilds << endl;
+		id->stats() << "walk-memo-hits\t" << walkMemoHits << endl;
+		if ( id->counterReps > 0 )
+			id->stats() << "counter-reps\t" << fsmCtx->nextCounterRep << endl;
+	}
+
 	/* If any errors have occured in the input file then don't write anything. */
 	if ( id->errorCount > 0 )
 		return FsmRes( FsmRes::InternalError() );
 
+	/* The match action reports the tagged states as they are entered. It goes
+	 * on after minimization, so it merges no fewer states. */
+	if ( id->matchIds ) {
+		Action *match = actionDict.find( "match" );
+		if ( match != 0 )
+			sectionGraph->matchIdToStateAction( fsmCtx->curActionOrd++, match );
+	}
+
 	fsmCtx->analyzeGraph( sectionGraph );
 
 	/* Depends on the graph analysis. */
@@ -1451,6 +1647,14 @@ void ParseData::generateReduced( const char *inputFileName, CodeStyle codeStyle,
 	Reducer *red = new Reducer( this->id, fsmCtx, sectionGraph, sectionName, machineId );
 	red->make( hostLang, alphType );
 
+	/* The machine could only be built as an NFA. */
+	if ( lazyDfa )
+		codeStyle = GenLazyDfa;
+
+	/* An input histogram guides the choice of default transitions. */
+	if ( id->histogramFn != 0 )
+		red->redFsm->histogram = id->histogram;
+
 	CodeGenArgs args( this->id, red, alphType, machineId, inputFileName, sectionName, out, codeStyle );
 
 	args.lineDirectives = !id->noLineDirectives;
@@ -1462,6 +1666,11 @@ void ParseData::generateReduced( const char *inputFileName, CodeStyle codeStyle,
 
 	/* Code generation anlysis step. */
 	cgd->genAnalysis();
+
+	if ( id->nfaMemo && red->redFsm->bNfaMemoNeeded && !red->redFsm->bNfaMemo ) {
+		id->warning( sectionLoc ) << "NFA visited set not generated, the outcome of "
+				"backtracking depends on more than state and position" << endl;
+	}
 }
 
 #if 0
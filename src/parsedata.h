@@ -115,6 +115,10 @@ typedef AvlMap<std::string, int, CmpString> PriorDict;
 typedef AvlMapEl<std::string, int> LocalErrDictEl;
 typedef AvlMap<std::string, int, CmpString> LocalErrDict;
 
+/* Machines built from definitions, for copying at later references. */
+typedef BstMapEl<VarDef*, FsmAp*> WalkMemoEl;
+typedef BstMap<VarDef*, FsmAp*> WalkMemo;
+
 /* Tree of instantiated names. */
 typedef AvlMapEl<std::string, NameMapVal*> NameMapEl;
 typedef AvlMap<std::string, NameMapVal*, CmpString> NameMap;
@@ -328,6 +332,28 @@ struct ParseData
 
 	LengthDefList lengthDefList;
 
+	/* The machine was too large and was built for the lazy DFA runtime. */
+	bool lazyDfa;
+
+	/* Instance being built whose alternatives get pattern numbers. */
+	VarDef *matchIdDef;
+
+	/* Instance being built whose top-level union may fall back to an NFA. */
+	VarDef *nfaFallbackDef;
+
+	/* Repetitions with a bound at least this large are built as counter
+	 * loops. Zero while walking without them. */
+	long counterReps;
+
+	/* The array the counter loops count in, set with variable reps. */
+	InlineList *repsExpr;
+	std::string repsVar();
+	void dropCounterActions( Action *last );
+
+	WalkMemo walkMemo;
+	long walkMemoHits;
+	long walkMemoBuilds;
+
 	CodeGenData *cgd;
 
 	struct Cut
@@ -359,7 +385,7 @@ Key makeFsmKeyHex( char *str, const InputLoc &loc, ParseData *pd );
 Key makeFsmKeyDec( char *str, const InputLoc &loc, ParseData *pd );
 Key makeFsmKeyNum( char *str, const InputLoc &loc, ParseData *pd );
 Key makeFsmKeyChar( char c, ParseData *pd );
-void makeFsmKeyArray( Key *result, char *data, int len, ParseData *pd );
+int makeFsmKeyArray( Key *result, char *data, int len, ParseData *pd );
 void makeFsmUniqueKeyArray( KeySet &result, const char *data, int len, 
 		bool caseInsensitive, ParseData *pd );
 FsmAp *makeBuiltin( BuiltinMachine builtin, ParseData *pd );
@@ -23,6 +23,7 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <fstream>
 #include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -128,13 +129,58 @@ Key *prepareHexString( ParseData *pd, const InputLoc &loc,
 	return dest;
 }
 
+/* True if nothing below the name can be the target of, or make, a reference
+ * by name. The machine built under it is then the same at every reference. */
+static bool nameFree( NameInst *name )
+{
+	if ( name->isLabel || name->numRefs > 0 || name->referencedNames.length() > 0 ||
+			name->start != 0 || name->final != 0 )
+		return false;
+
+	for ( NameVect::Iter child = name->childVect; child.lte(); child++ ) {
+		if ( !nameFree( *child ) )
+			return false;
+	}
+	return true;
+}
+
 FsmRes VarDef::walk( ParseData *pd )
 {
 	/* We enter into a new name scope. */
 	NameFrame nameFrame = pd->enterNameScope( true, 1 );
 
-	/* Recurse on the expression. */
-	FsmRes rtnVal = machineDef->walk( pd );
+	/* Definitions referenced again get a copy of the machine built at the
+	 * first reference, if nothing in them depends on the names or on the
+	 * orderings handed out as the tree is walked. */
+	bool memo = pd->matchIdDef != this && nameFree( pd->curNameInst );
+	if ( memo ) {
+		WalkMemoEl *memoEl = pd->walkMemo.find( this );
+		if ( memoEl != 0 ) {
+			pd->walkMemoHits += 1;
+			pd->popNameScope( nameFrame );
+			return FsmRes( FsmRes::Fsm(), new FsmAp( *memoEl->value ) );
+		}
+	}
+
+	int actionOrd = pd->fsmCtx->curActionOrd;
+	int priorOrd = pd->fsmCtx->curPriorOrd;
+	int priorKey = pd->fsmCtx->nextPriorKey;
+	int epsilonLink = pd->nextEpsilonResolvedLink;
+
+	/* Recurse on the expression. A union at the top may fall back to an NFA
+	 * union if making it deterministic takes too many states. */
+	bool usedNfa = false;
+	FsmRes rtnVal( FsmRes::Fsm(), 0 );
+	if ( pd->matchIdDef == this && machineDef->type == MachineDef::JoinType &&
+			machineDef->join->exprList.length() == 1 )
+		rtnVal = machineDef->join->exprList.head->walkMatchIds( pd );
+	else if ( pd->nfaFallbackDef == this && machineDef->type == MachineDef::JoinType &&
+			machineDef->join->exprList.length() == 1 &&
+			machineDef->join->exprList.head->type == Expression::OrType )
+		rtnVal = machineDef->join->exprList.head->walkNfaFallback( pd, usedNfa );
+	else
+		rtnVal = machineDef->walk( pd );
+
 	if ( !rtnVal.success() )
 		return rtnVal;
 	
@@ -149,7 +195,7 @@ FsmRes VarDef::walk( ParseData *pd )
 	 * then it just had epsilon transisions resolved. If it is a join
 	 * with only a single expression then run the epsilon op now. */
 	if ( machineDef->type == MachineDef::JoinType &&
-			machineDef->join->exprList.length() == 1 )
+			machineDef->join->exprList.length() == 1 && !usedNfa )
 	{
 		rtnVal = FsmAp::epsilonOp( rtnVal.fsm );
 		if ( !rtnVal.success() )
@@ -164,11 +210,72 @@ FsmRes VarDef::walk( ParseData *pd )
 	if ( pd->curNameInst->numRefs > 0 )
 		rtnVal.fsm->setEntry( pd->curNameInst->id, rtnVal.fsm->startState );
 
+	if ( memo && actionOrd == pd->fsmCtx->curActionOrd &&
+			priorOrd == pd->fsmCtx->curPriorOrd &&
+			priorKey == pd->fsmCtx->nextPriorKey &&
+			epsilonLink == pd->nextEpsilonResolvedLink )
+	{
+		pd->walkMemo.insert( this, new FsmAp( *rtnVal.fsm ) );
+		pd->walkMemoBuilds += 1;
+	}
+
 	/* Pop the name scope. */
 	pd->popNameScope( nameFrame );
 	return rtnVal;
 }
 
+/* Used when the machine is too large to make deterministic. If it is a union
+ * at the top level, each alternative is made deterministic on its own and the
+ * start state gets an NFA transition to each of them. The lazy DFA runtime
+ * does the rest of the subset construction as the input requires it. */
+FsmRes VarDef::walkLazy( ParseData *pd )
+{
+	if ( machineDef->type != MachineDef::JoinType ||
+			machineDef->join->exprList.length() != 1 )
+		return FsmRes( FsmRes::TooManyStates() );
+
+	/* Collect the alternatives, left to right. */
+	TermVect terms;
+	Expression *expr = machineDef->join->exprList.head;
+	while ( expr->type == Expression::OrType ) {
+		terms.prepend( expr->term );
+		expr = expr->expression;
+	}
+
+	if ( expr->type != Expression::TermType || terms.length() == 0 )
+		return FsmRes( FsmRes::TooManyStates() );
+
+	terms.prepend( expr->term );
+
+	NameFrame nameFrame = pd->enterNameScope( true, 1 );
+
+	long numMachines = 0;
+	FsmAp **machines = new FsmAp*[terms.length()];
+	for ( TermVect::Iter term = terms; term.lte(); term++ ) {
+		FsmRes res = (*term)->walk( pd );
+		if ( !res.success() ) {
+			for ( int m = 0; m < numMachines; m++ )
+				delete machines[m];
+			delete[] machines;
+			return res;
+		}
+
+		res.fsm->removeUnreachableStates();
+		res.fsm->minimizePartition2();
+		machines[numMachines++] = res.fsm;
+	}
+
+	pd->popNameScope( nameFrame );
+
+	if ( pd->id->printStatistics )
+		pd->id->stats() << "lazy-dfa-alternatives\t" << numMachines << endl;
+
+	FsmRes res = FsmAp::nfaUnionOp( machines[0], machines + 1,
+			numMachines - 1, 0, pd->id->stats() );
+	delete[] machines;
+	return res;
+}
+
 void VarDef::makeNameTree( const InputLoc &loc, ParseData *pd )
 {
 	/* The variable definition enters a new scope. */
@@ -729,6 +836,159 @@ Expression::~Expression()
 		delete term;
 }
 
+/* Walks a chain of unions. The operands are first unioned as usual, but with
+ * the state limit set to a multiple of their total size. If that is exceeded
+ * they are combined with an NFA union instead. Depths of one to four are
+ * tried and, of those that stay under the limit, the one with the lowest
+ * breadth cost is kept. */
+FsmRes Expression::walkNfaFallback( ParseData *pd, bool &usedNfa )
+{
+	/* Collect the operands, left to right. */
+	Vector<Expression*> chain;
+	Expression *left = this;
+	while ( left->type == OrType ) {
+		chain.prepend( left );
+		left = left->expression;
+	}
+
+	long numMachines = 0;
+	FsmAp **machines = new FsmAp*[chain.length() + 1];
+
+	FsmRes res = left->walk( pd, false );
+	for ( int i = 0; res.success(); i++ ) {
+		machines[numMachines++] = res.fsm;
+		if ( i == chain.length() )
+			break;
+		res = chain[i]->term->walk( pd );
+	}
+
+	if ( !res.success() ) {
+		for ( int m = 0; m < numMachines; m++ )
+			delete machines[m];
+		delete[] machines;
+		return res;
+	}
+
+	long operandStates = 0;
+	for ( int m = 0; m < numMachines; m++ )
+		operandStates += machines[m]->stateList.length();
+
+	long limit = operandStates * pd->id->nfaFallback;
+	long savedLimit = pd->fsmCtx->stateLimit;
+	if ( savedLimit == FsmCtx::STATE_UNLIMITED || limit < savedLimit )
+		pd->fsmCtx->stateLimit = limit;
+
+	/* Try the deterministic union on copies. */
+	res = FsmRes( FsmRes::Fsm(), new FsmAp( *machines[0] ) );
+	for ( int m = 1; m < numMachines && res.success(); m++ )
+		res = FsmAp::unionOp( res.fsm, new FsmAp( *machines[m] ), m == numMachines - 1 );
+
+	pd->fsmCtx->stateLimit = savedLimit;
+
+	if ( res.success() || res.type != FsmRes::TypeTooManyStates ) {
+		for ( int m = 0; m < numMachines; m++ )
+			delete machines[m];
+		delete[] machines;
+		return res;
+	}
+
+	/* Pick the depth. */
+	std::ostream &stats = pd->id->stats();
+	bool printStatistics = pd->id->printStatistics;
+
+	FsmAp *best = 0;
+	double bestCost = 0;
+	long bestDepth = 0;
+	for ( long depth = 4; depth >= 1; depth-- ) {
+		NfaRoundVect rounds;
+		rounds.append( NfaRound( depth, 0 ) );
+
+		FsmAp **copies = new FsmAp*[numMachines];
+		for ( int m = 0; m < numMachines; m++ )
+			copies[m] = new FsmAp( *machines[m] );
+
+		FsmRes nfa = FsmAp::nfaUnion( rounds, copies, numMachines, stats, false );
+		delete[] copies;
+
+		if ( !nfa.success() ) {
+			delete best;
+			for ( int m = 0; m < numMachines; m++ )
+				delete machines[m];
+			delete[] machines;
+			return nfa;
+		}
+
+		/* Depth one is always kept if nothing else fit. */
+		if ( nfa.fsm->stateList.length() > limit && ( depth > 1 || best != 0 ) ) {
+			delete nfa.fsm;
+			continue;
+		}
+
+		double cost = 0;
+		int minDepth = 0;
+		FsmAp::breadthFromEntry( cost, minDepth, pd->id->histogram, nfa.fsm, nfa.fsm->startState );
+
+		if ( best == 0 || cost < bestCost ) {
+			delete best;
+			best = nfa.fsm;
+			bestCost = cost;
+			bestDepth = depth;
+		}
+		else {
+			delete nfa.fsm;
+		}
+	}
+
+	if ( printStatistics ) {
+		stats << "nfa-fallback\t" << numMachines << "\t" << bestDepth << "\t" <<
+				best->stateList.length() << "\t" << bestCost << endl;
+	}
+
+	for ( int m = 0; m < numMachines; m++ )
+		delete machines[m];
+	delete[] machines;
+
+	usedNfa = true;
+	return FsmRes( FsmRes::Fsm(), best );
+}
+
+/* Walk a union at the top of an instance, numbering the alternatives from one,
+ * left to right, and tagging the final states of each with its number. */
+FsmRes Expression::walkMatchIds( ParseData *pd )
+{
+	Vector<Expression*> chain;
+	Expression *left = this;
+	while ( left->type == OrType ) {
+		chain.prepend( left );
+		left = left->expression;
+	}
+
+	FsmRes res = left->walk( pd, chain.length() == 0 );
+	if ( !res.success() )
+		return res;
+
+	res.fsm->matchIdFinStates( 1 );
+
+	for ( int i = 0; i < chain.length(); i++ ) {
+		FsmRes rhs = chain[i]->term->walk( pd );
+		if ( !rhs.success() ) {
+			delete res.fsm;
+			return rhs;
+		}
+
+		rhs.fsm->matchIdFinStates( i + 2 );
+
+		res = FsmAp::unionOp( res.fsm, rhs.fsm, i == chain.length() - 1 );
+		if ( !res.success() )
+			return res;
+	}
+
+	if ( pd->id->printStatistics )
+		pd->id->stats() << "match-ids\t" << chain.length() + 1 << endl;
+
+	return res;
+}
+
 /* Evaluate a single expression node. */
 FsmRes Expression::walk( ParseData *pd, bool lastInSeq )
 {
@@ -1437,6 +1697,92 @@ FactorWithRep::~FactorWithRep()
 }
 
 
+/* Does the machine take one character to its only final state and do nothing
+ * else? Actions, priorities and conditions could observe how a repetition is
+ * built, so only a plain character class may be counted. */
+static bool singleCharMachine( FsmAp *fsm )
+{
+	if ( fsm->stateList.length() != 2 || fsm->finStateSet.length() != 1 ||
+			fsm->startState->isFinState() || fsm->entryPoints.length() > 0 )
+		return false;
+
+	StateAp *fin = fsm->finStateSet[0];
+	if ( fin->outList.length() > 0 || fsm->hasOutData( fin ) )
+		return false;
+
+	for ( StateList::Iter st = fsm->stateList; st.lte(); st++ ) {
+		if ( st->toStateActionTable.length() > 0 ||
+				st->fromStateActionTable.length() > 0 ||
+				st->eofActionTable.length() > 0 ||
+				st->errActionTable.length() > 0 ||
+				st->guardedInTable.length() > 0 ||
+				st->nfaOut != 0 || st->eofTarget != 0 )
+			return false;
+	}
+
+	for ( TransList::Iter trans = fsm->startState->outList; trans.lte(); trans++ ) {
+		if ( !trans->plain() || trans->tdap()->toState != fin ||
+				trans->tdap()->actionTable.length() > 0 ||
+				trans->tdap()->priorTable.length() > 0 )
+			return false;
+	}
+
+	return true;
+}
+
+static Action *counterAction( ParseData *pd, const InputLoc &loc,
+		const char *name, const std::string &code )
+{
+	InlineList *inlineList = new InlineList;
+	inlineList->append( new InlineItem( loc, code, InlineItem::Text ) );
+
+	Action *action = new Action( loc, name, inlineList, pd->fsmCtx->nextCondId++ );
+	action->embedRoots.append( pd->curNameInst );
+	pd->fsmCtx->actionList.append( action );
+	return action;
+}
+
+/* With --counter-reps a repetition whose bound reaches the threshold is
+ * built from one copy of the operand. */
+bool FactorWithRep::counterRepOk( ParseData *pd, FsmAp *fsm )
+{
+	if ( pd->counterReps <= 0 )
+		return false;
+
+	long bound = type == ExactType || type == MinType ? lowerRep : upperRep;
+
+	return bound >= pd->counterReps && singleCharMachine( fsm );
+}
+
+/* The repetition becomes a loop over the operand that counts the iterations
+ * in element k of the reps array, entering only while the count is below the
+ * upper bound and leaving only once it reaches the lower bound. This is what
+ * the :cond operators build from user actions. */
+FsmRes FactorWithRep::counterRepeat( ParseData *pd, FsmAp *fsm )
+{
+	long min = lowerRep, max = upperRep;
+	if ( type == ExactType )
+		max = lowerRep;
+	else if ( type == MaxType )
+		min = 0;
+	else if ( type == MinType )
+		max = -1;
+
+	std::stringstream reps, minTest, maxTest;
+	reps << pd->repsVar() << "[" << pd->fsmCtx->nextCounterRep++ << "]";
+	minTest << reps.str() << " >= " << min;
+	maxTest << reps.str() << " < " << max;
+
+	Action *ini = counterAction( pd, loc, "rep_ini", reps.str() + " = 0;" );
+	Action *inc = counterAction( pd, loc, "rep_inc", reps.str() + " += 1;" );
+	Action *minCond = counterAction( pd, loc, "rep_min", minTest.str() );
+	Action *maxCond = max < 0 ? 0 : counterAction( pd, loc, "rep_max", maxTest.str() );
+
+	if ( min == 0 )
+		return FsmAp::condStar( fsm, pd->nextRepId++, ini, inc, minCond, maxCond );
+	return FsmAp::condPlus( fsm, pd->nextRepId++, ini, inc, minCond, maxCond );
+}
+
 /* Evaluate a factor with repetition node. */
 FsmRes FactorWithRep::walk( ParseData *pd )
 {
@@ -1521,6 +1867,9 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			}
 		}
 
+		if ( counterRepOk( pd, factorTree.fsm ) )
+			return counterRepeat( pd, factorTree.fsm );
+
 		/* Handles the n == 0 case. */
 		return FsmAp::exactRepeatOp( factorTree.fsm, lowerRep );
 	}
@@ -1547,6 +1896,9 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			}
 		}
 			
+		if ( counterRepOk( pd, factorTree.fsm ) )
+			return counterRepeat( pd, factorTree.fsm );
+
 		/* Do the repetition on the machine. Handles the n == 0 case. */
 		return FsmAp::maxRepeatOp( factorTree.fsm, upperRep );
 	}
@@ -1560,6 +1912,9 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			pd->id->warning(loc) << "applying min repetition to a machine that "
 					"accepts zero length word" << endl;
 		}
+
+		if ( counterRepOk( pd, factorTree.fsm ) )
+			return counterRepeat( pd, factorTree.fsm );
 	
 		return FsmAp::minRepeatOp( factorTree.fsm, lowerRep ); 
 	}
@@ -1591,6 +1946,10 @@ FsmRes FactorWithRep::walk( ParseData *pd )
 			}
 
 		}
+
+		if ( counterRepOk( pd, factorTree.fsm ) )
+			return counterRepeat( pd, factorTree.fsm );
+
 		return FsmAp::rangeRepeatOp( factorTree.fsm, lowerRep, upperRep );
 	}
 	case FactorWithNegType: {
@@ -1956,7 +2315,7 @@ FsmAp *Literal::walk( ParseData *pd )
 		char *litstr = prepareLitString( pd->id, loc, data.data, data.length(), 
 				length, caseInsensitive );
 		Key *arr = new Key[length];
-		makeFsmKeyArray( arr, litstr, length, pd );
+		length = makeFsmKeyArray( arr, litstr, length, pd );
 
 		/* Make the new machine. */
 		if ( caseInsensitive )
@@ -1973,10 +2332,80 @@ FsmAp *Literal::walk( ParseData *pd )
 		rtnVal = FsmAp::concatFsm( pd->fsmCtx, arr, length );
 		delete[] arr;
 		break;
+	}
+	case LiteralList: {
+		rtnVal = walkLiteralList( pd );
+		break;
 	}}
 	return rtnVal;
 }
 
+/* The paths from makeIncludePathChecks. The first may be the name itself. */
+static void freeIncludePathChecks( const char **checks, const char *fileName )
+{
+	for ( const char **check = checks; *check != 0; check++ ) {
+		if ( *check != fileName )
+			delete[] *check;
+	}
+	delete[] checks;
+}
+
+/* Load a file with one literal per line and build the union of the literals
+ * directly. The file is searched for the same way as includes. */
+FsmAp *Literal::walkLiteralList( ParseData *pd )
+{
+	long length;
+	bool caseInsensitive;
+	char *fileName = prepareLitString( pd->id, loc, data.data, data.length(),
+			length, caseInsensitive );
+
+	const char **checks = pd->id->makeIncludePathChecks( loc.fileName, fileName );
+	long found = 0;
+	ifstream *inFile = pd->id->tryOpenInclude( checks, found );
+	if ( inFile == 0 ) {
+		pd->id->error(loc) << "literal list: failed to locate file" << endl;
+		const char **tried = checks;
+		while ( *tried != 0 )
+			pd->id->error(loc) << "literal list: attempted: \"" << *tried++ << '\"' << endl;
+		freeIncludePathChecks( checks, fileName );
+		delete[] fileName;
+		return FsmAp::emptyFsm( pd->fsmCtx );
+	}
+
+	Vector<Key*> words;
+	Vector<long> lens;
+	string line;
+	while ( getline( *inFile, line ) ) {
+		if ( line.size() > 0 && line[line.size()-1] == '\r' )
+			line.resize( line.size() - 1 );
+		if ( line.size() == 0 )
+			continue;
+
+		Key *arr = new Key[line.size()];
+		long len = makeFsmKeyArray( arr, (char*)line.data(), line.size(), pd );
+		words.append( arr );
+		lens.append( len );
+	}
+	delete inFile;
+
+	FsmAp *rtnVal = 0;
+	if ( words.length() == 0 ) {
+		pd->id->error(loc) << "literal list: no literals in " <<
+				checks[found] << endl;
+		rtnVal = FsmAp::emptyFsm( pd->fsmCtx );
+	}
+	else {
+		rtnVal = FsmAp::literalListFsm( pd->fsmCtx, words.data, lens.data,
+				words.length(), caseInsensitive );
+	}
+
+	for ( int i = 0; i < words.length(); i++ )
+		delete[] words[i];
+	freeIncludePathChecks( checks, fileName );
+	delete[] fileName;
+	return rtnVal;
+}
+
 /* Clean up after a regular expression object. */
 RegExpr::~RegExpr()
 {
@@ -2039,13 +2468,13 @@ FsmRes ReItem::walk( ParseData *pd, RegExpr *rootRegex )
 		case Data: {
 			/* Move the data into an integer array and make a concat fsm. */
 			Key *arr = new Key[data.length()];
-			makeFsmKeyArray( arr, data.data, data.length(), pd );
+			long len = makeFsmKeyArray( arr, data.data, data.length(), pd );
 
 			/* Make the concat fsm. */
 			if ( rootRegex != 0 && rootRegex->caseInsensitive )
-				rtnVal = FsmAp::concatFsmCI( pd->fsmCtx, arr, data.length() );
+				rtnVal = FsmAp::concatFsmCI( pd->fsmCtx, arr, len );
 			else
-				rtnVal = FsmAp::concatFsm( pd->fsmCtx, arr, data.length() );
+				rtnVal = FsmAp::concatFsm( pd->fsmCtx, arr, len );
 			delete[] arr;
 			break;
 		}
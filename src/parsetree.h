@@ -247,6 +247,7 @@ struct VarDef
 
 	/* Parse tree traversal. */
 	FsmRes walk( ParseData *pd );
+	FsmRes walkLazy( ParseData *pd );
 	void makeNameTree( const InputLoc &loc, ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
 
@@ -452,6 +453,8 @@ struct Expression
 
 	/* Tree traversal. */
 	FsmRes walk( ParseData *pd, bool lastInSeq = true );
+	FsmRes walkNfaFallback( ParseData *pd, bool &usedNfa );
+	FsmRes walkMatchIds( ParseData *pd );
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
 
@@ -604,6 +607,10 @@ struct FactorWithRep
 	void makeNameTree( ParseData *pd );
 	void resolveNameRefs( ParseData *pd );
 
+	/* Large repetitions as loops guarded by a counter. */
+	bool counterRepOk( ParseData *pd, FsmAp *fsm );
+	FsmRes counterRepeat( ParseData *pd, FsmAp *fsm );
+
 	InputLoc loc;
 	long long repId;
 	FactorWithRep *factorWithRep;
@@ -755,7 +762,7 @@ struct Range
 /* Some literal machine. Can be a number or literal string. */
 struct Literal
 {
-	enum LiteralType { Number, LitString, HexString };
+	enum LiteralType { Number, LitString, HexString, LiteralList };
 
 	Literal( const InputLoc &loc, bool neg, const char *_data, int len, LiteralType type )
 		: loc(loc), neg(neg), type(type)
@@ -764,6 +771,7 @@ struct Literal
 	}
 
 	FsmAp *walk( ParseData *pd );
+	FsmAp *walkLiteralList( ParseData *pd );
 	
 	InputLoc loc;
 	bool neg;
@@ -91,7 +91,16 @@ RedFsmAp::RedFsmAp( FsmCtx *fsmCtx, int machineId )
 	bAnyTransCondRefs(false),
 	bAnyNfaCondRefs(false),
 	nextClass(0),
-	classMap(0)
+	classMap(0),
+	classPageBits(0),
+	numClassPages(0),
+	classPageMap(0),
+	numClassPageData(0),
+	histogram(0),
+	bNfaMemoNeeded(false),
+	bNfaMemo(false),
+	maxStack(0),
+	maxNfaStack(0)
 {
 }
 
@@ -110,6 +119,8 @@ RedFsmAp::~RedFsmAp()
 	delete[] allStates;
 	if ( classMap != 0 )
 		delete[] classMap;
+	if ( classPageMap != 0 )
+		delete[] classPageMap;
 
 	for ( TransApSet::Iter ti = transSet; ti.lte(); ti++ ) {
 		if ( ti->condSpace != 0 )
@@ -693,6 +704,9 @@ void RedFsmAp::makeFlat()
 	}
 }
 
+/* Alphabet spans beyond this get a paged class map. */
+static const long long denseClassSpan = 4096;
+
 void RedFsmAp::characterClass( EquivList &equiv )
 {
 	/* Find the global low and high keys. */
@@ -807,9 +821,19 @@ void RedFsmAp::characterClass( EquivList &equiv )
 		c->value = el->value;
 	}
 
+	this->lowKey = lowKey;
+	this->highKey = highKey;
+	this->nextClass = next;
+
+	/* Wide alphabets get a two-level map. */
+	long long maxSpan = keyOps->span( lowKey, highKey );
+	if ( maxSpan > denseClassSpan ) {
+		classPaged( equiv, maxSpan );
+		return;
+	}
+
 	/* Build the map and emit arrays from the range-based equiv classes. Will
 	 * likely crash if there are no transitions in the FSM. */
-	long long maxSpan = keyOps->span( lowKey, highKey );
 	long long *dest = new long long[maxSpan];
 	memset( dest, 0, sizeof(long long) * maxSpan );
 
@@ -820,11 +844,123 @@ void RedFsmAp::characterClass( EquivList &equiv )
 			dest[base + s] = c->value;
 	}
 
-	this->lowKey = lowKey;
-	this->highKey = highKey;
 	this->classMap = dest;
-	this->nextClass = next;
+}
+
+/* Split the class map into pages indexed by the high bits of the key offset.
+ * The page size is grown until the page index is no more than 64K entries.
+ * The class ranges are walked rather than the keys. Pages that lie inside one
+ * class share a page filled with that class, so the long runs that make up
+ * most of a 16 or 32 bit alphabet cost one page between them. Only the pages
+ * that a class boundary falls in are filled in key by key, and identical ones
+ * are stored once. The pages take the place of the flat class map. */
+void RedFsmAp::classPaged( EquivList &equiv, long long maxSpan )
+{
+	int bits = 8;
+	while ( ( ( maxSpan - 1 ) >> bits ) >= 0x10000 )
+		bits += 1;
+
+	long long pageSize = 1LL << bits;
+	long long numPages = ( ( maxSpan - 1 ) >> bits ) + 1;
+
+	classPageBits = bits;
+	numClassPages = numPages;
+	classPageMap = new long long[numPages];
+
+	/* Distinct pages, concatenated. Pages of one class are found by the
+	 * class, the others by a hash. On a hash collision the page is just
+	 * stored again. */
+	Vector<long long> pages;
+	BstMap<long long, long long> single;
+	BstMap<unsigned long long, long long> found;
+
+	long long *page = new long long[pageSize];
+	EquivClass *c = equiv.head;
+	for ( long long p = 0; p < numPages; ) {
+		long long base = p << bits;
+		long long end = base + pageSize < maxSpan ? base + pageSize : maxSpan;
+
+		while ( keyOps->span( lowKey, c->highKey ) - 1 < base )
+			c = c->next;
+
+		long long cBase = keyOps->span( lowKey, c->lowKey ) - 1;
+		long long cEnd = keyOps->span( lowKey, c->highKey );
+		long long value = c->value;
+		long long run = p + 1;
+
+		if ( cBase <= base && cEnd >= end ) {
+			/* The class covers this page and those up to its end. */
+			run = cEnd >= maxSpan ? numPages : cEnd >> bits;
+		}
+		else {
+			memset( page, 0, sizeof(long long) * pageSize );
+
+			bool same = true;
+			for ( long long s = 0; base + s < end; ) {
+				while ( keyOps->span( lowKey, c->highKey ) - 1 < base + s )
+					c = c->next;
+
+				long long e = keyOps->span( lowKey, c->highKey ) - base;
+				if ( e > end - base )
+					e = end - base;
+				if ( c->value != value )
+					same = false;
+				for ( ; s < e; s++ )
+					page[s] = c->value;
+			}
+
+			if ( !same ) {
+				/* FNV-1a over the page. */
+				unsigned long long hash = 14695981039346656037ULL;
+				for ( long long s = 0; s < pageSize; s++ ) {
+					hash ^= (unsigned long long) page[s];
+					hash *= 1099511628211ULL;
+				}
+
+				BstMapEl<unsigned long long, long long> *el = found.find( hash );
+				if ( el != 0 && memcmp( pages.data + ( el->value << bits ),
+						page, sizeof(long long) * pageSize ) == 0 )
+				{
+					classPageMap[p++] = el->value;
+				}
+				else {
+					long long id = pages.length() >> bits;
+					if ( el == 0 )
+						found.insert( hash, id );
+					pages.append( page, pageSize );
+					classPageMap[p++] = id;
+				}
+				continue;
+			}
+		}
+
+		BstMapEl<long long, long long> *el = single.find( value );
+		if ( el == 0 ) {
+			el = single.insert( value, pages.length() >> bits );
+			for ( long long s = 0; s < pageSize; s++ )
+				page[s] = value;
+			pages.append( page, pageSize );
+		}
+
+		for ( ; p < run; p++ )
+			classPageMap[p] = el->value;
+	}
+	delete[] page;
+
+	numClassPageData = pages.length();
+	classMap = new long long[numClassPageData];
+	memcpy( classMap, pages.data, sizeof(long long) * numClassPageData );
+}
+
+/* Class of the key at offset off from lowKey. */
+long long RedFsmAp::classAt( long long off )
+{
+	if ( classPageMap == 0 )
+		return classMap[off];
 
+	long long page = classPageMap[off >> classPageBits];
+	long long mask = ( 1LL << classPageBits ) - 1;
+	return classMap[( page << classPageBits ) + ( off & mask )];
 }
 
 void RedFsmAp::makeFlatClass()
@@ -854,11 +990,11 @@ void RedFsmAp::makeFlatClass()
 				if ( pair.userState == RangePairIter<PiList<EquivClass>, PiVector<RedTransEl> >::RangeOverlap ||
 						pair.userState == RangePairIter<PiList<EquivClass>, PiVector<RedTransEl> >::RangeInS2 )
 				{
-					long long off = keyOps->span( lowKey, pair.s2Tel.lowKey ) - 1;
-					if ( classMap[off] < st->low )
-						st->low = classMap[off];
-					if ( classMap[off] > st->high )
-						st->high = classMap[off];
+					long long cls = classAt( keyOps->span( lowKey, pair.s2Tel.lowKey ) - 1 );
+					if ( cls < st->low )
+						st->low = cls;
+					if ( cls > st->high )
+						st->high = cls;
 				}
 			}
 
@@ -872,8 +1008,8 @@ void RedFsmAp::makeFlatClass()
 				if ( pair.userState == RangePairIter< PiList<EquivClass>, PiVector<RedTransEl> >::RangeOverlap ||
 						pair.userState == RangePairIter< PiList<EquivClass>, PiVector<RedTransEl> >::RangeInS2 )
 				{
-					long long off = keyOps->span( lowKey, pair.s2Tel.lowKey ) - 1;
-					st->transList[ classMap[off] - st->low ] = pair.s2Tel.trans->value;
+					long long cls = classAt( keyOps->span( lowKey, pair.s2Tel.lowKey ) - 1 );
+					st->transList[ cls - st->low ] = pair.s2Tel.trans->value;
 				}
 			}
 
@@ -989,6 +1125,98 @@ void RedFsmAp::chooseDefaultSpan()
 	}
 }
 
+/* Sum the input histogram over a range of keys. The histogram is indexed by
+ * byte value. Keys that fall outside of a byte get no weight. */
+double RedFsmAp::keyFreq( Key lowKey, Key highKey )
+{
+	long low = lowKey.getVal();
+	long high = highKey.getVal();
+	if ( low < -128 )
+		low = -128;
+	if ( high > 255 )
+		high = 255;
+
+	double freq = 0;
+	for ( long i = low; i <= high; i++ )
+		freq += histogram[i & 0xff];
+	return freq;
+}
+
+/* Pick the transition that takes most of the input, according to the input
+ * histogram. Returns null if no transition dominates, in which case the caller
+ * should fall back to the span. */
+RedTransAp *RedFsmAp::chooseDefaultFreq( RedStateAp *state )
+{
+	/* Make a set of transitions from the outRange. */
+	RedTransSet stateTransSet;
+	for ( RedTransList::Iter rtel = state->outRange; rtel.lte(); rtel++ )
+		stateTransSet.insert( rtel->value );
+	
+	/* For each transition find how much of the input it takes. */
+	double total = 0;
+	double *freq = new double[stateTransSet.length()];
+	memset( freq, 0, sizeof(double) * stateTransSet.length() );
+	for ( RedTransList::Iter rtel = state->outRange; rtel.lte(); rtel++ ) {
+		/* Lookup the transition in the set. */
+		RedTransAp **inSet = stateTransSet.find( rtel->value );
+		double f = keyFreq( rtel->lowKey, rtel->highKey );
+		freq[inSet - stateTransSet.data] += f;
+		total += f;
+	}
+
+	/* Find the most frequent transition. */
+	RedTransAp *maxTrans = 0;
+	double maxFreq = 0;
+	for ( RedTransSet::Iter rtel = stateTransSet; rtel.lte(); rtel++ ) {
+		if ( freq[rtel.pos()] > maxFreq ) {
+			maxFreq = freq[rtel.pos()];
+			maxTrans = *rtel;
+		}
+	}
+
+	delete[] freq;
+
+	/* Only worth it if it takes at least half of the input. */
+	if ( total <= 0 || maxFreq * 2 < total )
+		return 0;
+
+	return maxTrans;
+}
+
+/* Pick default transitions by input frequency. The hottest transition becomes
+ * the default and, if it is made of a few ranges only, these are recorded in
+ * hotRange so the code generator can test them ahead of the search. */
+void RedFsmAp::chooseDefaultFreq()
+{
+	/* Loop the states. */
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		/* As with the span, only pick a default if the alphabet is
+		 * covered. */
+		if ( alphabetCovered( st->outRange ) ) {
+			RedTransAp *defTrans = chooseDefaultFreq( st );
+			if ( defTrans != 0 ) {
+				RedTransList hotRange;
+				for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+					if ( rtel->value == defTrans )
+						hotRange.append( *rtel );
+				}
+
+				/* Nothing to test ahead if the transition is all there is. */
+				if ( hotRange.length() <= 3 &&
+						hotRange.length() < st->outRange.length() )
+					st->hotRange.transfer( hotRange );
+			}
+			else {
+				defTrans = chooseDefaultSpan( st );
+			}
+
+			/* Rewrite the transition list taking out the transition we picked
+			 * as the default and store the default. */
+			moveToDefault( defTrans, st );
+		}
+	}
+}
+
 RedTransAp *RedFsmAp::chooseDefaultGoto( RedStateAp *state )
 {
 	/* Make a set of transitions from the outRange. */
@@ -1122,6 +1350,315 @@ RedCondAp *RedFsmAp::allocateCond( RedStateAp *targ, RedAction *action )
 	return inDict;
 }
 
+bool RedFsmAp::keywordWalk( RedStateAp *state, RedKeyword &cur, RedKeywordList &words,
+		bool *onPath, int maxWords, int maxLen )
+{
+	if ( state->nfaTargs != 0 || state->eofTrans != 0 )
+		return false;
+
+	if ( state->isFinal ) {
+		if ( words.length() == maxWords )
+			return false;
+		words.append( cur );
+		words[words.length()-1].targ = state;
+	}
+
+	onPath[state->id] = true;
+	for ( RedTransList::Iter rtel = state->outRange; rtel.lte(); rtel++ ) {
+		if ( rtel->value->condSpace != 0 )
+			return false;
+
+		RedCondPair *cond = rtel->value->outCond( 0 );
+		if ( cond->targ == 0 || cond->targ == errState )
+			continue;
+
+		/* Cycles mean the set is not finite. */
+		if ( onPath[cond->targ->id] || cur.keys.length() == maxLen )
+			return false;
+
+		if ( keyOps->span( rtel->lowKey, rtel->highKey ) > (unsigned long long)maxWords )
+			return false;
+
+		Key key = rtel->lowKey;
+		while ( true ) {
+			cur.keys.append( key );
+			if ( cond->action != 0 ) {
+				RedKeywordAct act;
+				act.pos = cur.keys.length() - 1;
+				act.action = cond->action;
+				cur.acts.append( act );
+			}
+
+			if ( !keywordWalk( cond->targ, cur, words, onPath, maxWords, maxLen ) )
+				return false;
+
+			if ( cond->action != 0 )
+				cur.acts.remove( cur.acts.length() - 1 );
+			cur.keys.remove( cur.keys.length() - 1 );
+
+			if ( keyOps->eq( key, rtel->highKey ) )
+				break;
+			keyOps->increment( key );
+		}
+	}
+	onPath[state->id] = false;
+
+	return true;
+}
+
+/* A keyword machine accepts a finite set of strings and uses no conditions or
+ * NFA transitions. Collects every accepted string, along with the actions
+ * taken on the way and the state it ends in. Must be called while the
+ * outRange lists are still complete, before defaults are chosen. */
+bool RedFsmAp::keywordSet( RedKeywordList &words, int maxWords, int maxLen )
+{
+	if ( startState == 0 )
+		return false;
+
+	bool *onPath = new bool[nextStateId];
+	memset( onPath, 0, sizeof(bool) * nextStateId );
+
+	RedKeyword cur;
+	bool result = keywordWalk( startState, cur, words, onPath, maxWords, maxLen );
+
+	delete[] onPath;
+	return result;
+}
+
+static void nfaAddTarg( Vector<RedStateAp*> &stack, bool *visited, RedTransAp *trans )
+{
+	for ( int c = 0; c < trans->numConds(); c++ ) {
+		RedStateAp *targ = trans->outCond( c )->targ;
+		if ( targ != 0 && !visited[targ->id] ) {
+			visited[targ->id] = true;
+			stack.append( targ );
+		}
+	}
+}
+
+/* Is the state reachable from any of the NFA alternatives of from. */
+bool RedFsmAp::nfaReaches( RedStateAp *from, RedStateAp *to, bool *visited )
+{
+	memset( visited, 0, sizeof(bool) * nextStateId );
+
+	Vector<RedStateAp*> stack;
+	for ( RedNfaTargs::Iter s = *from->nfaTargs; s.lte(); s++ ) {
+		if ( !visited[s->state->id] ) {
+			visited[s->state->id] = true;
+			stack.append( s->state );
+		}
+	}
+
+	while ( stack.length() > 0 ) {
+		RedStateAp *state = stack[stack.length()-1];
+		stack.remove( stack.length()-1 );
+
+		if ( state == to )
+			return true;
+
+		for ( RedTransList::Iter rtel = state->outRange; rtel.lte(); rtel++ )
+			nfaAddTarg( stack, visited, rtel->value );
+		for ( RedTransList::Iter rtel = state->outSingle; rtel.lte(); rtel++ )
+			nfaAddTarg( stack, visited, rtel->value );
+		if ( state->defTrans != 0 )
+			nfaAddTarg( stack, visited, state->defTrans );
+
+		if ( state->nfaTargs != 0 ) {
+			for ( RedNfaTargs::Iter s = *state->nfaTargs; s.lte(); s++ ) {
+				if ( !visited[s->state->id] ) {
+					visited[s->state->id] = true;
+					stack.append( s->state );
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+/* When an NFA state lies on a cycle the backtracking runtime can arrive at
+ * the same state and position along exponentially many paths. Without such a
+ * cycle the number of alternatives explored does not grow with the input. */
+void RedFsmAp::nfaMemoAnalysis()
+{
+	bNfaMemoNeeded = false;
+
+	bool *visited = new bool[nextStateId];
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		if ( st->nfaTargs != 0 && nfaReaches( st, st, visited ) ) {
+			bNfaMemoNeeded = true;
+			break;
+		}
+	}
+	delete[] visited;
+}
+
+/*
+ * Flow estimates. Transitions are weighted by the share of the input that
+ * flows along them. The key frequencies of the input histogram, or a flat
+ * one, give the chance of taking each transition, and a Markov estimate from
+ * the start state gives how often each state is visited.
+ */
+
+struct PartEdge
+{
+	int targ;
+	double weight;
+};
+
+/* Chance that the next key is in lowKey .. highKey. */
+double RedFsmAp::partitionFreq( Key lowKey, Key highKey )
+{
+	if ( histogram != 0 )
+		return keyFreq( lowKey, highKey );
+
+	long low = lowKey.getVal();
+	long high = highKey.getVal();
+	if ( low < -128 )
+		low = -128;
+	if ( high > 255 )
+		high = 255;
+	return high < low ? 0 : ( high - low + 1 ) / 256.0;
+}
+
+/* Add the transition's share of the state's outgoing input to the weights of
+ * its targets. Self loops are only needed for estimating visits. */
+static void partAddTrans( Vector<PartEdge> *out, RedStateAp *st,
+		RedTransAp *trans, double freq, bool loops )
+{
+	int numConds = trans->numConds();
+	for ( int c = 0; c < numConds; c++ ) {
+		RedStateAp *targ = trans->outCond( c )->targ;
+		if ( targ != 0 && ( loops || targ != st ) ) {
+			PartEdge edge = { targ->id, freq / numConds };
+			out[st->id].append( edge );
+		}
+	}
+}
+
+/* Chance of each transition out of each state. The chance of erroring is
+ * dropped. */
+void RedFsmAp::partitionEdges( Vector<PartEdge> *out, bool loops )
+{
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		double taken = 0;
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+			double f = partitionFreq( rtel->lowKey, rtel->highKey );
+			partAddTrans( out, st, rtel->value, f, loops );
+			taken += f;
+		}
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			double f = partitionFreq( rtel->lowKey, rtel->highKey );
+			partAddTrans( out, st, rtel->value, f, loops );
+			taken += f;
+		}
+		if ( st->defTrans != 0 && taken < 1 )
+			partAddTrans( out, st, st->defTrans, 1 - taken, loops );
+
+		/* All NFA alternatives are tried. */
+		if ( st->nfaTargs != 0 ) {
+			for ( RedNfaTargs::Iter s = *st->nfaTargs; s.lte(); s++ ) {
+				PartEdge edge = { s->state->id, 1 };
+				out[st->id].append( edge );
+			}
+		}
+	}
+}
+
+/* Visits per key, starting over at the start state whenever the machine
+ * errors or stops. */
+void RedFsmAp::partitionVisits( Vector<PartEdge> *out, double *visits )
+{
+	int n = nextStateId;
+	double *next = new double[n];
+
+	for ( int i = 0; i < n; i++ )
+		visits[i] = 0;
+	if ( startState != 0 )
+		visits[startState->id] = 1;
+
+	for ( int iter = 0; iter < 32 && startState != 0; iter++ ) {
+		for ( int i = 0; i < n; i++ )
+			next[i] = 0;
+
+		double sum = 0;
+		for ( int i = 0; i < n; i++ ) {
+			for ( Vector<PartEdge>::Iter e = out[i]; e.lte(); e++ ) {
+				next[e->targ] += visits[i] * e->weight;
+				sum += visits[i] * e->weight;
+			}
+		}
+
+		if ( sum < 1 )
+			next[startState->id] += 1 - sum;
+		else {
+			for ( int i = 0; i < n; i++ )
+				next[i] /= sum;
+		}
+
+		/* Swap by copy, the caller owns visits. */
+		memcpy( visits, next, sizeof(double) * n );
+	}
+
+	delete[] next;
+}
+
+/* Expected runs of each action list per key of input, indexed by action list
+ * id. Transition actions are weighted by the flow along the transition, state
+ * actions by the visits to the state. The caller frees the result. */
+double *RedFsmAp::actionListFreq()
+{
+	int n = nextStateId;
+	Vector<PartEdge> *out = new Vector<PartEdge>[n];
+	double *visits = new double[n];
+
+	partitionEdges( out, true );
+	partitionVisits( out, visits );
+
+	int numLists = actionMap.length();
+	double *freq = new double[numLists];
+	for ( int i = 0; i < numLists; i++ )
+		freq[i] = 0;
+
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		double v = visits[st->id];
+		if ( st->toStateAction != 0 )
+			freq[st->toStateAction->actListId] += v;
+		if ( st->fromStateAction != 0 )
+			freq[st->fromStateAction->actListId] += v;
+
+		double taken = 0;
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+			double f = partitionFreq( rtel->lowKey, rtel->highKey );
+			transListFreq( freq, rtel->value, v * f );
+			taken += f;
+		}
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+			double f = partitionFreq( rtel->lowKey, rtel->highKey );
+			transListFreq( freq, rtel->value, v * f );
+			taken += f;
+		}
+		if ( st->defTrans != 0 && taken < 1 )
+			transListFreq( freq, st->defTrans, v * ( 1 - taken ) );
+	}
+
+	delete[] visits;
+	delete[] out;
+
+	return freq;
+}
+
+/* Conditions split the transition's flow evenly. */
+void RedFsmAp::transListFreq( double *freq, RedTransAp *trans, double flow )
+{
+	int numConds = trans->numConds();
+	for ( int c = 0; c < numConds; c++ ) {
+		RedAction *action = trans->outCond( c )->action;
+		if ( action != 0 )
+			freq[action->actListId] += flow / numConds;
+	}
+}
+
 void RedFsmAp::partitionFsm( int nparts )
 {
 	/* At this point the states are ordered by a depth-first traversal. We
@@ -1190,3 +1727,567 @@ void RedFsmAp::setInTrans()
 		}
 	}
 }
+
+/* Whether to branch on the conditions one at a time instead of adding up the
+ * key and searching for it. A tree can duplicate condition code, so it is
+ * kept to small condition spaces. */
+bool RedTransAp::condTree()
+{
+	return condSpace != 0 && condSpace->condSet.length() <= 5;
+}
+
+/* The pair taken for every key of the condition space, or the error pair,
+ * which may be null. Outcomes must have room for condFullSize() entries. */
+void RedTransAp::condOutcomes( RedCondPair **outcomes )
+{
+	long fullSize = condFullSize();
+	for ( long k = 0; k < fullSize; k++ )
+		outcomes[k] = errCond();
+	for ( int c = 0; c < numConds(); c++ )
+		outcomes[outCondKey( c ).getVal()] = outCond( c );
+}
+
+/* Number of different outcomes over the keys that have the bits of mask set
+ * as in val. */
+static long condLeaves( RedCondPair **outcomes, long fullSize, long mask, long val )
+{
+	long leaves = 0;
+	for ( long k = 0; k < fullSize; k++ ) {
+		if ( ( k & mask ) != val )
+			continue;
+
+		/* Count the key if it is the first with its outcome. */
+		long j = 0;
+		while ( j < k && ( ( j & mask ) != val || outcomes[j] != outcomes[k] ) )
+			j++;
+		if ( j == k )
+			leaves += 1;
+	}
+	return leaves;
+}
+
+/* The condition to test next when the conditions in mask are known to be as
+ * in val, or -1 if the outcome is decided. Conditions that do not change the
+ * outcome are never picked. Of the rest, take the one that leaves the fewest
+ * outcomes to tell apart, then the one with the least code. */
+int RedTransAp::condSplit( RedCondPair **outcomes, long mask, long val )
+{
+	long fullSize = condFullSize();
+	if ( condLeaves( outcomes, fullSize, mask, val ) <= 1 )
+		return -1;
+
+	int best = -1;
+	long bestLeaves = 0, bestCost = 0;
+	for ( GenCondSet::Iter csi = condSpace->condSet; csi.lte(); csi++ ) {
+		long bit = 1 << csi.pos();
+		if ( mask & bit )
+			continue;
+
+		long leaves =
+				condLeaves( outcomes, fullSize, mask | bit, val ) +
+				condLeaves( outcomes, fullSize, mask | bit, val | bit );
+		long cost = (*csi)->inlineList->length();
+
+		/* A condition is needed only if some key's outcome changes with it. */
+		bool splits = false;
+		for ( long k = 0; k < fullSize && !splits; k++ ) {
+			if ( ( k & mask ) == val && ( k & bit ) == 0 &&
+					outcomes[k] != outcomes[k | bit] )
+				splits = true;
+		}
+
+		if ( splits && ( best < 0 || leaves < bestLeaves ||
+				( leaves == bestLeaves && cost < bestCost ) ) )
+		{
+			best = csi.pos();
+			bestLeaves = leaves;
+			bestCost = cost;
+		}
+	}
+	return best;
+}
+
+/*
+ * Static stack depths.
+ */
+
+/* Control by value seen in action code. */
+enum StackByValue
+{
+	StackCallByValue = 0x1,
+	StackJumpByValue = 0x2
+};
+
+/* Collects the states the action code moves to. Calls are kept apart from
+ * gotos and nexts. Control by value makes the result unknown. */
+static void stackItems( GenInlineList *inlineList, Vector<int> &next,
+		Vector<int> &calls, int &byValue )
+{
+	for ( GenInlineList::Iter item = *inlineList; item.lte(); item++ ) {
+		switch ( item->type ) {
+			case GenInlineItem::Call: case GenInlineItem::Ncall:
+				calls.append( item->targState->id );
+				break;
+			case GenInlineItem::Goto: case GenInlineItem::Next:
+				next.append( item->targState->id );
+				break;
+			case GenInlineItem::CallExpr: case GenInlineItem::NcallExpr:
+				byValue |= StackCallByValue;
+				break;
+			case GenInlineItem::GotoExpr: case GenInlineItem::NextExpr:
+				byValue |= StackJumpByValue;
+				break;
+			default:
+				break;
+		}
+
+		if ( item->children != 0 )
+			stackItems( item->children, next, calls, byValue );
+	}
+}
+
+static void stackAction( RedAction *action, Vector<int> &next,
+		Vector<int> &calls, int &byValue )
+{
+	if ( action != 0 ) {
+		for ( GenActionTable::Iter item = action->key; item.lte(); item++ ) {
+			if ( item->value->inlineList != 0 )
+				stackItems( item->value->inlineList, next, calls, byValue );
+		}
+	}
+}
+
+static void stackTrans( RedTransAp *trans, Vector<int> &next,
+		Vector<int> &calls, int &byValue )
+{
+	for ( int c = 0; c < trans->numConds(); c++ ) {
+		RedCondPair *cond = trans->outCond( c );
+		if ( cond->targ != 0 )
+			next.append( cond->targ->id );
+		stackAction( cond->action, next, calls, byValue );
+	}
+}
+
+/* Where control can go from each state. The return from a call goes to the
+ * target of the calling transition, which is already in next. */
+void RedFsmAp::stackEdges( Vector<int> *next, Vector<int> *calls, int &byValue )
+{
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		Vector<int> &n = next[st->id], &c = calls[st->id];
+
+		for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ )
+			stackTrans( rtel->value, n, c, byValue );
+		for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ )
+			stackTrans( rtel->value, n, c, byValue );
+		if ( st->defTrans != 0 )
+			stackTrans( st->defTrans, n, c, byValue );
+		if ( st->eofTrans != 0 )
+			stackTrans( st->eofTrans, n, c, byValue );
+
+		stackAction( st->toStateAction, n, c, byValue );
+		stackAction( st->fromStateAction, n, c, byValue );
+		stackAction( st->eofAction, n, c, byValue );
+
+		if ( st->nfaTargs != 0 ) {
+			for ( RedNfaTargs::Iter s = *st->nfaTargs; s.lte(); s++ ) {
+				n.append( s->state->id );
+				stackAction( s->push, n, c, byValue );
+				stackAction( s->popTest, n, c, byValue );
+			}
+		}
+	}
+}
+
+/* Longest path in calls from a frame, or -1 if a cycle is reachable, in which
+ * case the cycle is left in stackCycle. Colour 0 is unvisited, 1 is on the
+ * path and 2 is done. */
+long RedFsmAp::callDepth( int frame, Vector<int> *callees,
+		int *colour, long *depth, Vector<int> &path )
+{
+	if ( colour[frame] == 2 )
+		return depth[frame];
+
+	if ( colour[frame] == 1 ) {
+		int start = path.length() - 1;
+		while ( path[start] != frame )
+			start -= 1;
+		for ( int i = start; i < path.length(); i++ )
+			stackCycle.append( path[i] );
+		return -1;
+	}
+
+	colour[frame] = 1;
+	path.append( frame );
+
+	long max = 0;
+	for ( Vector<int>::Iter c = callees[frame]; c.lte(); c++ ) {
+		long d = callDepth( *c, callees, colour, depth, path );
+		if ( d < 0 )
+			return -1;
+		if ( d + 1 > max )
+			max = d + 1;
+	}
+
+	path.remove( path.length() - 1 );
+	colour[frame] = 2;
+	depth[frame] = max;
+	return max;
+}
+
+/* The most fcall frames that can be on the stack. Each call target starts a
+ * frame made of the states it reaches without calling. The frame calls the
+ * targets of the calls made in those states. */
+void RedFsmAp::maxCallStack( Vector<int> *next, Vector<int> *calls, int byValue )
+{
+	if ( byValue & StackCallByValue ) {
+		maxStack = -1;
+		return;
+	}
+
+	int n = nextStateId;
+	Vector<int> *callees = new Vector<int>[n];
+	bool *inFrame = new bool[n];
+	bool *isFrame = new bool[n];
+	int *colour = new int[n];
+	long *depth = new long[n];
+
+	for ( int i = 0; i < n; i++ ) {
+		isFrame[i] = false;
+		colour[i] = 0;
+	}
+
+	Vector<int> frames;
+	if ( startState != 0 ) {
+		frames.append( startState->id );
+		isFrame[startState->id] = true;
+	}
+	for ( RedStateSet::Iter en = entryPoints; en.lte(); en++ ) {
+		if ( !isFrame[(*en)->id] ) {
+			frames.append( (*en)->id );
+			isFrame[(*en)->id] = true;
+		}
+	}
+	int roots = frames.length();
+
+	for ( int f = 0; f < frames.length(); f++ ) {
+		int frame = frames[f];
+		for ( int i = 0; i < n; i++ )
+			inFrame[i] = ( byValue & StackJumpByValue ) != 0;
+
+		/* A goto by value may land anywhere, so the frame is everything. */
+		Vector<int> work;
+		if ( !inFrame[frame] ) {
+			work.append( frame );
+			inFrame[frame] = true;
+		}
+		while ( work.length() > 0 ) {
+			int s = work[work.length() - 1];
+			work.remove( work.length() - 1 );
+			for ( Vector<int>::Iter t = next[s]; t.lte(); t++ ) {
+				if ( !inFrame[*t] ) {
+					inFrame[*t] = true;
+					work.append( *t );
+				}
+			}
+		}
+
+		for ( int s = 0; s < n; s++ ) {
+			if ( !inFrame[s] )
+				continue;
+			for ( Vector<int>::Iter c = calls[s]; c.lte(); c++ ) {
+				callees[frame].append( *c );
+				if ( !isFrame[*c] ) {
+					frames.append( *c );
+					isFrame[*c] = true;
+				}
+			}
+		}
+	}
+
+	maxStack = 0;
+	Vector<int> path;
+	for ( int r = 0; r < roots && maxStack >= 0; r++ ) {
+		long d = callDepth( frames[r], callees, colour, depth, path );
+		maxStack = d < 0 ? -1 : ( d > maxStack ? d : maxStack );
+	}
+
+	delete[] callees;
+	delete[] inFrame;
+	delete[] isFrame;
+	delete[] colour;
+	delete[] depth;
+}
+
+/* Tarjan's components over all the ways control moves, calls included. */
+void RedFsmAp::nfaComponents( int s, Vector<int> *next, Vector<int> *calls,
+		int *index, int *low, int *comp, Vector<int> &stack, int &nextIndex, int &nextComp )
+{
+	index[s] = low[s] = nextIndex++;
+	stack.append( s );
+
+	for ( int k = 0; k < 2; k++ ) {
+		Vector<int> &out = k == 0 ? next[s] : calls[s];
+		for ( Vector<int>::Iter t = out; t.lte(); t++ ) {
+			if ( index[*t] < 0 ) {
+				nfaComponents( *t, next, calls, index, low, comp, stack, nextIndex, nextComp );
+				if ( low[*t] < low[s] )
+					low[s] = low[*t];
+			}
+			else if ( comp[*t] < 0 && index[*t] < low[s] )
+				low[s] = index[*t];
+		}
+	}
+
+	if ( low[s] == index[s] ) {
+		int t;
+		do {
+			t = stack[stack.length() - 1];
+			stack.remove( stack.length() - 1 );
+			comp[t] = nextComp;
+		} while ( t != s );
+		nextComp += 1;
+	}
+}
+
+/* The most entries nfa_bp can hold. Each visit to an NFA state pushes its
+ * alternatives, so the bound is the most alternatives pushed along any path.
+ * Pops are not counted against it. A loop through an NFA state has no
+ * bound. */
+void RedFsmAp::maxNfaStackDepth( Vector<int> *next, Vector<int> *calls, int byValue )
+{
+	if ( byValue != 0 ) {
+		maxNfaStack = -1;
+		return;
+	}
+
+	int n = nextStateId;
+	int *index = new int[n];
+	int *low = new int[n];
+	int *comp = new int[n];
+	for ( int i = 0; i < n; i++ )
+		index[i] = low[i] = comp[i] = -1;
+
+	Vector<int> stack;
+	int nextIndex = 0, nextComp = 0;
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		if ( index[st->id] < 0 ) {
+			nfaComponents( st->id, next, calls, index, low, comp,
+					stack, nextIndex, nextComp );
+		}
+	}
+
+	/* Components are numbered successors first. */
+	long *weight = new long[nextComp];
+	long *best = new long[nextComp];
+	bool *cyclic = new bool[nextComp];
+	for ( int c = 0; c < nextComp; c++ ) {
+		weight[c] = best[c] = 0;
+		cyclic[c] = false;
+	}
+
+	for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+		if ( st->nfaTargs != 0 )
+			weight[comp[st->id]] += st->nfaTargs->length();
+		for ( int k = 0; k < 2; k++ ) {
+			Vector<int> &out = k == 0 ? next[st->id] : calls[st->id];
+			for ( Vector<int>::Iter t = out; t.lte(); t++ ) {
+				if ( comp[*t] == comp[st->id] )
+					cyclic[comp[st->id]] = true;
+			}
+		}
+	}
+
+	maxNfaStack = 0;
+	for ( int c = 0; c < nextComp && maxNfaStack >= 0; c++ ) {
+		if ( cyclic[c] && weight[c] > 0 )
+			maxNfaStack = -1;
+	}
+
+	if ( maxNfaStack == 0 ) {
+		Vector<int> *members = new Vector<int>[nextComp];
+		for ( RedStateList::Iter st = stateList; st.lte(); st++ )
+			members[comp[st->id]].append( st->id );
+
+		for ( int c = 0; c < nextComp; c++ ) {
+			long succ = 0;
+			for ( Vector<int>::Iter s = members[c]; s.lte(); s++ ) {
+				for ( int k = 0; k < 2; k++ ) {
+					Vector<int> &out = k == 0 ? next[*s] : calls[*s];
+					for ( Vector<int>::Iter t = out; t.lte(); t++ ) {
+						if ( comp[*t] != c && best[comp[*t]] > succ )
+							succ = best[comp[*t]];
+					}
+				}
+			}
+			best[c] = weight[c] + succ;
+		}
+
+		delete[] members;
+
+		if ( startState != 0 )
+			maxNfaStack = best[comp[startState->id]];
+		for ( RedStateSet::Iter en = entryPoints; en.lte(); en++ ) {
+			if ( best[comp[(*en)->id]] > maxNfaStack )
+				maxNfaStack = best[comp[(*en)->id]];
+		}
+	}
+
+	delete[] index;
+	delete[] low;
+	delete[] comp;
+	delete[] weight;
+	delete[] best;
+	delete[] cyclic;
+}
+
+/* Static bounds on the depth of the call stack and the NFA stack, -1 where
+ * there is none. */
+void RedFsmAp::stackDepths()
+{
+	int n = nextStateId;
+	Vector<int> *next = new Vector<int>[n];
+	Vector<int> *calls = new Vector<int>[n];
+	int byValue = 0;
+
+	stackCycle.empty();
+	stackEdges( next, calls, byValue );
+	maxCallStack( next, calls, byValue );
+	maxNfaStackDepth( next, calls, byValue );
+
+	delete[] next;
+	delete[] calls;
+}
+
+/*
+ * Synchronizing bytes.
+ */
+
+/* Whether action code leaves p and the state to the machine. A hold is
+ * allowed and reported, the key is then read again from the target. */
+static bool syncItems( GenInlineList *inlineList, bool &hold )
+{
+	for ( GenInlineList::Iter item = *inlineList; item.lte(); item++ ) {
+		switch ( item->type ) {
+			case GenInlineItem::Hold: case GenInlineItem::LmHold:
+				hold = true;
+				break;
+			case GenInlineItem::Goto: case GenInlineItem::Call:
+			case GenInlineItem::Ncall: case GenInlineItem::Next:
+			case GenInlineItem::Ret: case GenInlineItem::Nret:
+			case GenInlineItem::GotoExpr: case GenInlineItem::CallExpr:
+			case GenInlineItem::NcallExpr: case GenInlineItem::NextExpr:
+			case GenInlineItem::Exec: case GenInlineItem::LmExec:
+			case GenInlineItem::Break: case GenInlineItem::Nbreak:
+				return false;
+			default:
+				break;
+		}
+
+		if ( item->children != 0 && !syncItems( item->children, hold ) )
+			return false;
+	}
+	return true;
+}
+
+static bool syncAction( RedAction *action, bool &hold )
+{
+	if ( action != 0 ) {
+		for ( GenActionTable::Iter item = action->key; item.lte(); item++ ) {
+			if ( item->value->inlineList != 0 &&
+					!syncItems( item->value->inlineList, hold ) )
+				return false;
+		}
+	}
+	return true;
+}
+
+/* The transition st takes on key. */
+RedTransAp *RedFsmAp::keyTrans( RedStateAp *st, Key key )
+{
+	for ( RedTransList::Iter rtel = st->outSingle; rtel.lte(); rtel++ ) {
+		if ( !keyOps->lt( key, rtel->lowKey ) && !keyOps->gt( key, rtel->highKey ) )
+			return rtel->value;
+	}
+	for ( RedTransList::Iter rtel = st->outRange; rtel.lte(); rtel++ ) {
+		if ( !keyOps->lt( key, rtel->lowKey ) && !keyOps->gt( key, rtel->highKey ) )
+			return rtel->value;
+	}
+	return st->defTrans;
+}
+
+/* The state the machine is in after reading key in st, or null if that
+ * depends on more than the key: conditions, errors and control changes in
+ * actions. */
+RedStateAp *RedFsmAp::syncTarg( RedStateAp *st, Key key )
+{
+	/* Holds can chain, but not further than there are states. */
+	for ( int steps = 0; steps < nextStateId; steps++ ) {
+		bool hold = false;
+		if ( !syncAction( st->fromStateAction, hold ) || hold )
+			return 0;
+
+		RedTransAp *trans = keyTrans( st, key );
+		if ( trans == 0 || trans->condSpace != 0 || trans->numConds() != 1 )
+			return 0;
+
+		RedCondPair *pair = trans->outCond( 0 );
+		RedStateAp *targ = pair->targ;
+		if ( targ == 0 || targ == errState ||
+				!syncAction( pair->action, hold ) ||
+				!syncAction( targ->toStateAction, hold ) )
+			return 0;
+
+		if ( !hold )
+			return targ;
+
+		st = targ;
+	}
+	return 0;
+}
+
+/* For every key of a one byte alphabet, the id of the one state the machine
+ * is in after reading it, whatever state it was in, or -1. In a scanner only
+ * the start state counts, any other is inside a token. Returns the number of
+ * such keys. syncTargs is left empty if the analysis does not apply. */
+long RedFsmAp::syncAnalysis( bool scanner )
+{
+	syncTargs.empty();
+
+	if ( startState == 0 || bAnyNfaStates ||
+			keyOps->span( keyOps->minKey, keyOps->maxKey ) > 256 )
+		return 0;
+
+	for ( int i = 0; i < 256; i++ )
+		syncTargs.append( -1 );
+
+	long numSync = 0;
+	Key key = keyOps->minKey;
+	while ( true ) {
+		RedStateAp *sync = 0;
+		for ( RedStateList::Iter st = stateList; st.lte(); st++ ) {
+			if ( st == errState )
+				continue;
+
+			RedStateAp *targ = syncTarg( st, key );
+			if ( targ == 0 || ( sync != 0 && targ != sync ) ) {
+				sync = 0;
+				break;
+			}
+			sync = targ;
+		}
+
+		if ( sync != 0 && scanner && sync != startState )
+			sync = 0;
+
+		if ( sync != 0 ) {
+			syncTargs[(unsigned char)key.getVal()] = sync->id;
+			numSync += 1;
+		}
+
+		if ( keyOps->eq( key, keyOps->maxKey ) )
+			break;
+		keyOps->increment( key );
+	}
+
+	return numSync;
+}
@@ -1025,6 +1025,7 @@ void Scanner::endSection( )
 		":condstar("  => { token( TK_ColonCondStarOpen ); };
 		":condplus("  => { token( TK_ColonCondPlusOpen ); };
 		":nomax(" => { token( TK_ColonNoMaxOpen ); };
+		":literals(" => { token( TK_ColonLiteralsOpen ); };
 		"):"      => { token( TK_CloseColon ); };
 
 		# Opening of longest match.
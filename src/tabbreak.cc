@@ -194,6 +194,8 @@ void TabBreak::writeExec()
 	out <<
 		"	{\n";
 
+	NFA_MEMO_DECLARE();
+
 	DECLARE( INT(), ps );
 	DECLARE( INT(), cpc );
 	DECLARE( INT(), nbreak );
@@ -211,6 +213,8 @@ void TabBreak::writeExec()
 	DECLARE( INT(), new_recs );
 	DECLARE( INT(), alt );
 	DECLARE( INT(), ic );
+
+	NFA_MEMO_INIT();
 	
 	out << BREAK_LABEL( _resume );
 
@@ -165,6 +165,8 @@ void TabGoto::writeExec()
 	out <<
 		"	{\n";
 
+	NFA_MEMO_DECLARE();
+
 	DECLARE( INT(), ps );
 	DECLARE( INT(), cpc );
 	DECLARE( INT(), nbreak );
@@ -182,6 +184,10 @@ void TabGoto::writeExec()
 	DECLARE( INT(), alt );
 	DECLARE( INT(), ic );
 	
+	NFA_MEMO_INIT();
+	UTF8_DECLARE();
+	STATE_LOAD();
+
 	out << EMIT_LABEL( _resume );
 
 	/* Do we break out on no more input. */
@@ -222,6 +228,7 @@ void TabGoto::writeExec()
 			"else {\n";
 	}
 
+	UTF8_DECODE();
 	LOCATE_TRANS();
 
 	if ( !noEnd && eof ) {
@@ -325,6 +332,8 @@ void TabGoto::writeExec()
 
 	out << EMIT_LABEL( _out );
 
+	STATE_STORE();
+
 	out << "	}\n";
 }
 
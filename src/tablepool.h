@@ -0,0 +1,62 @@
+/*
+ * Copyright 2026 Adrian Thurston <thurston@colm.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _TABLEPOOL_H
+#define _TABLEPOOL_H
+
+#include <string>
+#include "vector.h"
+
+/*
+ * Tables already written to the output, by content. With --share-tables a
+ * table that matches one written by an earlier machine is defined as a
+ * pointer to it instead of being written again.
+ */
+struct SharedTable
+{
+	unsigned long hash;
+	std::string type;
+	bool isChar;
+	bool isSigned;
+	Vector<long long> values;
+
+	/* Expression that gives the first element's address. */
+	std::string addr;
+
+	SharedTable *next;
+};
+
+struct TablePool
+{
+	TablePool() : head(0) {}
+	~TablePool();
+
+	SharedTable *find( const std::string &type, bool isChar, bool isSigned,
+			const Vector<long long> &values );
+	void insert( const std::string &type, bool isChar, bool isSigned,
+			const Vector<long long> &values, const std::string &addr );
+
+private:
+	SharedTable *head;
+};
+
+#endif
@@ -135,6 +135,8 @@ void TabVar::writeExec()
 	out <<
 		"{\n";
 
+	NFA_MEMO_DECLARE();
+
 	DECLARE( INT(), ps );
 	DECLARE( INT(), cpc );
 	DECLARE( INT(), nbreak );
@@ -157,6 +159,8 @@ void TabVar::writeExec()
 	out << UINT() << " _cont = 1;\n";
 	out << UINT() << " _again = 1;\n";
 	out << UINT() << " _bsc = 1;\n";
+
+	NFA_MEMO_INIT();
 	
 	out << BREAK_LABEL( _resume );
 
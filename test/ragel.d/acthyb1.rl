@@ -0,0 +1,55 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --hybrid-threshold=0
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+char trace[64];
+int len;
+
+%%{
+	machine acthyb;
+
+	action x { trace[len++] = 'x'; }
+	action y { trace[len++] = 'y'; }
+	action z { trace[len++] = 'z'; }
+	action done { trace[len++] = 'd'; }
+	action fin { trace[len++] = 'F'; }
+
+	# With a threshold of zero, -T3 and -F3 expand every action list, the
+	# EOF action included.
+	main := ( 'a' @x | 'b' @y @z )* 'c' @done %fin;
+}%%
+
+%% write data;
+
+void test( char *str )
+{
+	int cs;
+	char *p = str, *pe = str + strlen( str ), *eof = pe;
+
+	memset( trace, 0, sizeof(trace) );
+	len = 0;
+
+	%% write init;
+	%% write exec;
+
+	printf( "%s: %s %s\n", str, trace, cs >= acthyb_first_final ? "ok" : "fail" );
+}
+
+int main()
+{
+	test( "abac" );
+	test( "c" );
+	test( "bb" );
+	test( "ad" );
+	return 0;
+}
+
+##### OUTPUT #####
+abac: xyzxdF ok
+c: dF ok
+bb: yzyz fail
+ad: x fail
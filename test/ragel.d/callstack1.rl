@@ -0,0 +1,48 @@
+/*
+ * @LANG: c
+ * @PROHIBIT_FLAGS: --var-backend
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+%%{
+	machine test;
+
+	# Nested calls two deep. The stack is sized by the static bound.
+	two := 'y' @{ fret; };
+	one := 'x' @{ fcall two; } 'z' @{ fret; };
+	main := ( 'a' @{ fcall one; } '\n' )*;
+}%%
+
+%% write data;
+
+void test( const char *buf )
+{
+	int cs, top, stack[test_max_stack];
+	const char *p = buf;
+	const char *pe = buf + strlen( buf );
+
+	%% write init;
+	%% write exec;
+
+	if ( cs >= test_first_final )
+		printf( "ACCEPT\n" );
+	else
+		printf( "FAIL\n" );
+}
+
+int main()
+{
+	printf( "max_stack %d\n", test_max_stack );
+	test( "axyz\n" );
+	test( "axyz\naxyz\n" );
+	test( "axz\n" );
+	return 0;
+}
+
+##### OUTPUT #####
+max_stack 2
+ACCEPT
+ACCEPT
+FAIL
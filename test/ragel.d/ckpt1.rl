@@ -0,0 +1,95 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --checkpoints=2
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+int print;
+
+void tok( const char *kind, const char *ts, const char *te )
+{
+	if ( print )
+		printf( "%s [%.*s]\n", kind, (int)(te - ts), ts );
+}
+
+%%{
+	machine scan;
+
+	# A run of a is one token each, unless a b ends it. Every a of the run
+	# reads to its end.
+	main := |*
+		'a' => { tok( "a", ts, te ); };
+		'a'+ 'b' => { tok( "ab", ts, te ); };
+		[c-z]+ => { tok( "word", ts, te ); };
+		' ' => { tok( "space", ts, te ); };
+	*|;
+}%%
+
+%% write data;
+
+struct scan_ckpt_rec recs[16], last[16];
+struct scan_ckpts ckpts;
+long last_len;
+
+void full( const char *data )
+{
+	const char *p = data, *pe = data + strlen( data ), *eof = pe;
+	const char *ts, *te;
+	int cs, act;
+
+	ckpts.rec = recs;
+	ckpts.max = 16;
+	%% write init;
+	%% write exec;
+
+	memcpy( last, recs, sizeof(recs[0]) * ckpts.len );
+	last_len = ckpts.len;
+}
+
+/* Bytes [a, b) of the text full saw were replaced by n bytes, giving data. */
+void rescan( const char *data, long a, long b, long n )
+{
+	const char *p = data, *pe = data + strlen( data ), *eof = pe;
+	const char *ts, *te;
+	int cs, act;
+	long i;
+
+	ckpts.rec = recs;
+	ckpts.max = 16;
+	%% write init;
+
+	i = scan_ckpt_resume( &ckpts, last, last_len, a, b, n );
+	if ( i >= 0 ) {
+		p = data + last[i].off;
+		cs = last[i].cs;
+	}
+
+	printf( "resume at %ld\n", i >= 0 ? last[i].off : 0 );
+	print = 1;
+	%% write exec;
+	print = 0;
+	printf( "%s\n", ckpts.converged ? "converged" : "to the end" );
+}
+
+int main()
+{
+	/* Every record inside the run of a was taken after reading the space. */
+	full( "aaaaaaaa x" );
+	rescan( "aaaaaaaabx", 8, 9, 1 );
+
+	full( "ab cd ef gh" );
+	rescan( "ab cd kf gh", 6, 7, 1 );
+	return 0;
+}
+
+##### OUTPUT #####
+resume at 0
+ab [aaaaaaaab]
+word [x]
+to the end
+resume at 5
+space [ ]
+word [kf]
+converged
@@ -0,0 +1,47 @@
+/* 
+ * @LANG: indep
+ *
+ * Three guards on the same character that all lead to the same place. Any
+ * one being true decides the transition, so generated code can stop testing
+ * at the first one that holds.
+ */
+
+int a;
+int b;
+int c;
+
+%%{
+	machine foo;
+
+	action ca {a > 0}
+	action cb {b > 0}
+	action cc {c > 0}
+
+	action hit {
+		print_str "hit\n";
+	}
+
+	main := '>' @{ a = 0; b = 0; c = 0; }
+		( 'a' @{ a = 1; } | 'b' @{ b = 1; } | 'c' @{ c = 1; } )*
+		( 'x' when ca | 'x' when cb | 'x' when cc ) @hit '\n';
+}%%
+
+##### INPUT #####
+">x\n"
+">ax\n"
+">bx\n"
+">cx\n"
+">bcx\n"
+">cbax\n"
+##### OUTPUT #####
+FAIL
+hit
+ACCEPT
+hit
+ACCEPT
+hit
+ACCEPT
+hit
+ACCEPT
+hit
+ACCEPT
@@ -0,0 +1,129 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --counter-reps=8
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+%%{
+	machine word;
+	variable reps word_reps;
+	main := [a-z]{1,20} ' ';
+}%%
+
+%% write data;
+
+int word( char *str )
+{
+	int cs, word_reps[word_num_reps];
+	char *p = str, *pe = str + strlen( str );
+
+	%% write init;
+	%% write exec;
+
+	return cs >= word_first_final;
+}
+
+struct count_state
+{
+	int cs;
+	int reps[4];
+};
+
+%%{
+	machine count;
+	access st->;
+	main := [0-9]{10} '\n';
+}%%
+
+%% write data;
+
+int count( struct count_state *st, char *str )
+{
+	char *p = str, *pe = str + strlen( str );
+
+	%% write init;
+	%% write exec;
+
+	return st->cs >= count_first_final;
+}
+
+int letters;
+
+%%{
+	machine mixed;
+
+	action letter { letters += 1; }
+
+	# After "ab" the counting loop and the second branch are on the same
+	# letters, so the instance is built again with copies. Nothing declares
+	# reps here, so a counter left behind would not compile.
+	main := ( [a-z]{1,10} $letter ' ' ) | ( 'ab' [a-z]* '!' );
+}%%
+
+%% write data;
+
+int mixed( char *str )
+{
+	int cs;
+	char *p = str, *pe = str + strlen( str );
+
+	letters = 0;
+	%% write init;
+	%% write exec;
+
+	return cs >= mixed_first_final;
+}
+
+char *words[] = {
+	"hello ",
+	"abcdefghijklmnopqrst ",
+	"abcdefghijklmnopqrstu ",
+	" ",
+};
+
+char *counts[] = {
+	"0123456789\n",
+	"012345678\n",
+	"01234567890\n",
+};
+
+char *mixes[] = {
+	"abc ",
+	"abcd!",
+	"abcdefghijk ",
+	"x!",
+};
+
+int main()
+{
+	struct count_state st;
+	int i;
+
+	for ( i = 0; i < 4; i++ )
+		printf( "word %d: %s\n", i, word( words[i] ) ? "accept" : "fail" );
+
+	for ( i = 0; i < 3; i++ )
+		printf( "count %d: %s\n", i, count( &st, counts[i] ) ? "accept" : "fail" );
+
+	for ( i = 0; i < 4; i++ ) {
+		int res = mixed( mixes[i] );
+		printf( "mixed %d: %s %d\n", i, res ? "accept" : "fail", letters );
+	}
+
+	return 0;
+}
+
+##### OUTPUT #####
+word 0: accept
+word 1: accept
+word 2: fail
+word 3: fail
+count 0: accept
+count 1: fail
+count 2: fail
+mixed 0: accept 3
+mixed 1: accept 4
+mixed 2: fail 10
+mixed 3: fail 1
@@ -0,0 +1,66 @@
+/*
+ * @LANG: indep
+ *
+ * Start state has more than sixteen singles and ranges, so the large state
+ * search is used with --eytzinger-search.
+ */
+%%{
+	machine eytz1;
+
+	action matched {
+		print_str "matched\n";
+	}
+
+	main := (
+		'a' 'A' | 'b' 'B' | 'c' 'C' | 'd' 'D' | 'e' 'E' |
+		'f' 'F' | 'g' 'G' | 'h' 'H' | 'i' 'I' | 'j' 'J' |
+		'k' 'K' | 'l' 'L' | 'm' 'M' | 'n' 'N' | 'o' 'O' |
+		'p' 'P' | 'q' 'Q' | 'r' 'R' | 's' 'S' | 't' 'T' |
+		'0'..'1' 'a' | '2'..'3' 'b' | '4'..'5' 'c' | '6'..'7' 'd' |
+		'8'..'9' 'e' | 'u'..'v' 'f' | 'w'..'x' 'g' | 'y'..'z' 'h' |
+		'U'..'V' 'i' | 'W'..'X' 'j' | 'Y'..'Z' 'k' | '#'..'$' 'm' |
+		'%'..'&' 'n' | '('..')' 'o' | '*'..'+' 'p' | ','..'-' 'q' |
+		'.'..'/' 'r'
+	) '\n' @matched;
+}%%
+
+##### INPUT #####
+"aA\n"
+"kK\n"
+"tT\n"
+"aB\n"
+"0a\n"
+"1a\n"
+"9e\n"
+"zh\n"
+"Zk\n"
+"/r\n"
+"-q\n"
+"0b\n"
+"~a\n"
+"ua\n"
+##### OUTPUT #####
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+FAIL
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+FAIL
+FAIL
+FAIL
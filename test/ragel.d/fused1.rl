@@ -0,0 +1,124 @@
+/*
+ * @LANG: c
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+char log1[64], log2[64];
+int len1, len2;
+long curs1, curs2;
+
+%%{
+	machine words;
+	variable cs words_cs;
+
+	action word {
+		log1[len1++] = fc;
+		curs1 = curs1 * 31 + fcurs;
+	}
+
+	main := ( [a-z]+ >word ' ' )*;
+}%%
+
+%%{
+	machine digits;
+	variable cs digits_cs;
+
+	action digit {
+		log2[len2++] = fc;
+		curs2 = curs2 * 31 + fcurs;
+	}
+
+	main := ( [0-9] @digit | [^0-9] )*;
+}%%
+
+%% machine words; write data;
+%% machine digits; write data;
+
+struct result
+{
+	char log1[64], log2[64];
+	long curs1, curs2;
+	int cs1, cs2;
+};
+
+void reset()
+{
+	memset( log1, 0, sizeof(log1) );
+	memset( log2, 0, sizeof(log2) );
+	len1 = len2 = 0;
+	curs1 = curs2 = 0;
+}
+
+void save( struct result *r, int cs1, int cs2 )
+{
+	memcpy( r->log1, log1, sizeof(log1) );
+	memcpy( r->log2, log2, sizeof(log2) );
+	r->curs1 = curs1;
+	r->curs2 = curs2;
+	r->cs1 = cs1;
+	r->cs2 = cs2;
+}
+
+void separate( char *data, struct result *r )
+{
+	char *p, *pe = data + strlen( data );
+	int words_cs, digits_cs;
+
+	reset();
+	p = data;
+	%% machine words; write init; write exec;
+	p = data;
+	%% machine digits; write init; write exec;
+	save( r, words_cs, digits_cs );
+}
+
+void fused( char *data, struct result *r )
+{
+	char *p = data, *pe = data + strlen( data );
+	int words_cs, digits_cs;
+
+	reset();
+	%% machine words; write init;
+	%% machine digits; write init;
+	%% write fused words;
+	save( r, words_cs, digits_cs );
+}
+
+void test( char *data )
+{
+	struct result s, f;
+
+	separate( data, &s );
+	fused( data, &f );
+
+	printf( "words: %s %s\n", s.log1, s.cs1 == words_error ? "error" : "ok" );
+	printf( "digits: %s %s\n", s.log2, s.cs2 == digits_error ? "error" : "ok" );
+
+	if ( strcmp( s.log1, f.log1 ) == 0 && strcmp( s.log2, f.log2 ) == 0 &&
+			s.curs1 == f.curs1 && s.curs2 == f.curs2 &&
+			s.cs1 == f.cs1 && s.cs2 == f.cs2 )
+		printf( "fused: same\n" );
+	else
+		printf( "fused: differs\n" );
+}
+
+int main()
+{
+	test( "ab cde f " );
+	test( "ab 12 cd 3" );
+	test( "4 x5 " );
+	return 0;
+}
+
+##### OUTPUT #####
+words: acf ok
+digits:  ok
+fused: same
+words: a error
+digits: 123 ok
+fused: same
+words:  error
+digits: 45 ok
+fused: same
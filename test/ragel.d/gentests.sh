@@ -8,6 +8,9 @@
 #
 #    @RAGEL_FILE: file name to pass on the command line instead of file created
 #    by extracting section. Does not work with translated test cases.
+#
+#    @RAGEL_FLAGS: extra options passed to ragel for every run of the case,
+#    for features that are off by default.
 # 
 
 TRANS=./trans
@@ -70,7 +73,7 @@ while getopts "gcnmleT:F:W:G:P:CDJRAZOUKY-:" opt; do
 					langflags="$langflags --$OPTARG"
 					gen_opts="$gen_opts --$OPTARG"
 				;;
-				integral-tables|string-tables)
+				integral-tables|string-tables|eytzinger-search|blob-tables|asm-unroll)
 					genflags="$genflags --$OPTARG"
 					gen_opts="$gen_opts --$OPTARG"
 				;;
@@ -87,7 +90,7 @@ while getopts "gcnmleT:F:W:G:P:CDJRAZOUKY-:" opt; do
 done
 
 [ -z "$langflags" ]   && langflags="-C --asm -R -Y -O -U -J -Z -D -A -K"
-[ -z "$genflags" ]    && genflags="-T0 -T1 -F0 -F1 -W0 -W1 -G0 -G1 -G2 -n -m -e --string-tables"
+[ -z "$genflags" ]    && genflags="-T0 -T1 -T2 -T3 -F0 -F1 -F2 -F3 -W0 -W1 -G0 -G1 -G2 -n -m -e --string-tables --eytzinger-search --blob-tables --asm-unroll"
 
 shift $((OPTIND - 1));
 
@@ -149,7 +152,7 @@ function lang_opts()
 			host_ragel=$RAGEL_BIN
 			flags="-Wall -O3 -I. -Wno-variadic-macros"
 			libs=""
-			prohibit_flags=""
+			prohibit_flags="--asm-unroll"
 		;;
 		cg)
 			# For testing ragel-c using goto based.
@@ -160,7 +163,7 @@ function lang_opts()
 			host_ragel=$RAGEL_C_BIN
 			flags="-Wall -O3 -I. -Wno-variadic-macros"
 			libs=""
-			prohibit_flags="--string-tables"
+			prohibit_flags="--string-tables --blob-tables --asm-unroll"
 		;;
 		cv)
 			# For testing ragel-c using var-based
@@ -171,7 +174,7 @@ function lang_opts()
 			host_ragel="$RAGEL_C_BIN --var-backend"
 			flags="-Wall -O3 -I. -Wno-variadic-macros"
 			libs=""
-			prohibit_flags="-G0 -G1 -G2 --string-tables"
+			prohibit_flags="-G0 -G1 -G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		c++)
 			lang_opt=-C;
@@ -181,7 +184,7 @@ function lang_opts()
 			host_ragel=$RAGEL_BIN
 			flags="-Wall -O3 -I. -Wno-variadic-macros"
 			libs=""
-			prohibit_flags=""
+			prohibit_flags="--asm-unroll"
 		;;
 		obj-c)
 			lang_opt=-C;
@@ -195,7 +198,7 @@ function lang_opts()
 				flags="`$gnustep_config --objc-flags`"
 			fi
 			libs="-lobjc -lgnustep-base"
-			prohibit_flags=""
+			prohibit_flags="--asm-unroll"
 		;;
 		d)
 			lang_opt=-D;
@@ -205,7 +208,7 @@ function lang_opts()
 			host_ragel=$RAGEL_D_BIN
 			flags="-Wall -O3"
 			libs=""
-			prohibit_flags="--string-tables"
+			prohibit_flags="--string-tables --blob-tables --asm-unroll"
 		;;
 		java)
 			lang_opt=-J;
@@ -215,7 +218,7 @@ function lang_opts()
 			host_ragel=$RAGEL_JAVA_BIN
 			flags=""
 			libs=""
-			prohibit_flags="-G0 -G1 -G2 --string-tables"
+			prohibit_flags="-G0 -G1 -G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		ruby)
 			lang_opt=-R;
@@ -225,7 +228,7 @@ function lang_opts()
 			host_ragel=$RAGEL_RUBY_BIN
 			flags=""
 			libs=""
-			prohibit_flags="-G0 -G1 -G2 --string-tables"
+			prohibit_flags="-G0 -G1 -G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		csharp)
 			lang_opt="-A";
@@ -235,7 +238,7 @@ function lang_opts()
 			host_ragel=$RAGEL_CSHARP_BIN
 			flags=""
 			libs=""
-			prohibit_flags="-G2 --string-tables"
+			prohibit_flags="-G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		go)
 			lang_opt="-Z"
@@ -245,7 +248,7 @@ function lang_opts()
 			host_ragel=$RAGEL_GO_BIN
 			flags="build"
 			libs=""
-			prohibit_flags="--string-tables"
+			prohibit_flags="--string-tables --blob-tables --asm-unroll"
 		;;
 		ocaml)
 			lang_opt="-O"
@@ -255,7 +258,7 @@ function lang_opts()
 			host_ragel=$RAGEL_OCAML_BIN
 			flags=""
 			libs=""
-			prohibit_flags="-G0 -G1 -G2 --string-tables"
+			prohibit_flags="-G0 -G1 -G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		asm)
 			lang_opt="--asm"
@@ -265,7 +268,7 @@ function lang_opts()
 			host_ragel=$RAGEL_ASM_BIN
 			flags=""
 			libs=""
-			prohibit_flags="-T0 -T1 -F0 -F1 -W0 -W1 -G0 -G1 --string-tables"
+			prohibit_flags="-T0 -T1 -T2 -T3 -F0 -F1 -F2 -F3 -W0 -W1 -G0 -G1 --string-tables --eytzinger-search --blob-tables"
 		;;
 		rust)
 			lang_opt="-U"
@@ -276,7 +279,7 @@ function lang_opts()
 			flags="-A non_upper_case_globals -A dead_code \
 				-A unused_variables -A unused_assignments -A unused_mut -A unused_parens"
 			libs=""
-			prohibit_flags="-G0 -G1 -G2 --string-tables"
+			prohibit_flags="-G0 -G1 -G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		crack)
 			lang_opt="-K"
@@ -284,7 +287,7 @@ function lang_opts()
 			interpreted=true
 			compiler=$crack_interpreter
 			host_ragel=$RAGEL_CRACK_BIN
-			prohibit_flags="-G0 -G1 -G2 --string-tables"
+			prohibit_flags="-G0 -G1 -G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		julia)
 			lang_opt="-Y"
@@ -292,7 +295,7 @@ function lang_opts()
 			interpreted=true
 			compiler=$julia_interpreter
 			host_ragel=$RAGEL_JULIA_BIN
-			prohibit_flags="-G0 -G1 -G2 --string-tables"
+			prohibit_flags="-G0 -G1 -G2 --string-tables --blob-tables --asm-unroll"
 		;;
 		indep)
 		;;
@@ -317,7 +320,7 @@ function run_test()
 	classfile=$wk/`echo $lroot$gen_opt.class | sed 's/-\+/_/g'`
 	classname=`echo $lroot$gen_opt | sed 's/-\+/_/g'`
 
-	opts="$gen_opt $min_opt $enc_opt $f_opt"
+	opts="$gen_opt $min_opt $enc_opt $f_opt $case_ragel_flags"
 	args="-I. $opts -o $code_src $translated"
 
 	cat >> $sh <<-EOF
@@ -331,6 +334,10 @@ function run_test()
 		EOF
 	fi
 
+	# Table blobs are found by name in the working directory.
+	blob_flags=""
+	case "$opts" in *--blob-tables*) blob_flags="-Wa,-I$wk" ;; esac
+
 	out_args=""
 	[ $lang != java ] && out_args="-o $binary";
 	[ $lang == csharp ] && out_args="-out:$binary";
@@ -338,7 +345,7 @@ function run_test()
 	# Some langs are just interpreted.
 	if [ $interpreted != "true" ]; then
 		cat >> $sh <<-EOF
-		$compiler $flags $out_args $code_src \
+		$compiler $flags $blob_flags $out_args $code_src \
 				$libs >>$log 2>>$log
 		EOF
 	fi
@@ -432,6 +439,9 @@ function run_translate()
 	# Add these into the langugage-specific defaults selected in run_options
 	case_prohibit_flags=`sed '/@PROHIBIT_FLAGS:/s/^.*: *//p;d' $test_case`
 
+	# Passed to ragel in addition to the generated flag combinations.
+	case_ragel_flags=`sed '/@RAGEL_FLAGS:/s/^.*: *//p;d' $test_case`
+
 	lang=`sed '/@LANG:/s/^.*: *//p;d' $test_case`
 	if [ -z "$lang" ]; then
 		echo "$test_case: language unset"; >&2
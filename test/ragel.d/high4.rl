@@ -0,0 +1,62 @@
+/*
+ * @LANG: c
+ */
+
+/**
+ * A 32 bit alphabet with a handful of classes. The flat styles page the
+ * class map, and most of the pages lie inside one class.
+ */
+
+#include <stdio.h>
+
+%%{
+	machine high;
+	alphtype unsigned int;
+
+	main := (
+		'a' .. 'z' @{ printf( " lower" ); } |
+		0x4e00 .. 0x9fff @{ printf( " cjk" ); } |
+		0x10000 .. 0x7fffffff @{ printf( " wide" ); } |
+		0xffffffff @{ printf( " max" ); }
+	)*;
+}%%
+
+%% write data;
+
+void test( const unsigned int *data, int len )
+{
+	int cs;
+	const unsigned int *p = data;
+	const unsigned int *pe = data + len;
+
+	%% write init;
+	%% write exec;
+
+	printf( "%s\n", cs == high_error ? " error" : "" );
+}
+
+const unsigned int inp1[] = { 'a', 0x4e00, 0x9fff, 'z' };
+const unsigned int inp2[] = { 0x10000, 0x12345678, 0x7fffffff };
+const unsigned int inp3[] = { 0xffffffff, 'q' };
+const unsigned int inp4[] = { 'a', 0xa000 };
+const unsigned int inp5[] = { 0x10000, 0x80000000 };
+const unsigned int inp6[] = { 0xfffffffe };
+
+int main()
+{
+	test( inp1, 4 );
+	test( inp2, 3 );
+	test( inp3, 2 );
+	test( inp4, 2 );
+	test( inp5, 2 );
+	test( inp6, 1 );
+	return 0;
+}
+
+##### OUTPUT #####
+ lower cjk cjk lower
+ wide wide wide
+ max lower
+ lower error
+ wide error
+ error
@@ -0,0 +1,62 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --keyword-hash
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+int res, first, last;
+
+%%{
+	machine kw;
+
+	main := (
+		'if' @{ res = 1; } |
+		'else' @{ res = 2; } |
+		'while' @{ res = 3; } |
+		'return' @{ res = 4; }
+	) >{ first = fc; } @{ last = fc; };
+}%%
+
+%% write data;
+
+void test( char *chunks[] )
+{
+	int cs, i;
+
+	res = first = last = 0;
+	%% write init;
+
+	for ( i = 0; chunks[i] != 0; i++ ) {
+		char *p = chunks[i];
+		char *pe = p + strlen( p );
+		%% write exec;
+	}
+
+	printf( "%d %c %c %s\n", res, first ? first : '-', last ? last : '-',
+			cs >= kw_first_final ? "final" : "non-final" );
+}
+
+char *inp1[] = { "while", 0 };
+char *inp2[] = { "return", 0 };
+char *inp3[] = { "whilex", 0 };
+char *inp4[] = { "wh", "ile", 0 };
+char *inp5[] = { "els", 0 };
+
+int main()
+{
+	test( inp1 );
+	test( inp2 );
+	test( inp3 );
+	test( inp4 );
+	test( inp5 );
+	return 0;
+}
+
+##### OUTPUT #####
+3 w e final
+4 r n final
+3 w e non-final
+3 w e final
+0 e - non-final
@@ -0,0 +1,62 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --state-limit=16 --lazy-dfa=8
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+%%{
+	machine lazydfa;
+
+	# Each alternative alone is small. Together they have to remember the last
+	# three characters, which is more states than the limit.
+	main :=
+		any* 'a' any any |
+		any* 'b' any any;
+}%%
+
+%% write data;
+int cs;
+struct lazydfa_lz_cache lz_cache;
+struct lazydfa_lz_resume lz_resume;
+
+void exec( char *data, int len )
+{
+	char *p = data;
+	char *pe = data + len;
+	%% write exec;
+}
+
+void test( char *chunks[] )
+{
+	int i;
+
+	%% write init;
+
+	for ( i = 0; chunks[i] != 0; i++ ) {
+		exec( chunks[i], strlen(chunks[i]) );
+		printf( "%s ", cs >= lazydfa_first_final ? "final" : "non-final" );
+	}
+	printf( "\n" );
+}
+
+char *inp1[] = { "xxxaxx", 0 };
+char *inp2[] = { "xxxa", "xx", 0 };
+char *inp3[] = { "x", "b", "x", "x", "x", 0 };
+char *inp4[] = { "", "ab", "", "xy", 0 };
+
+int main( )
+{
+	test( inp1 );
+	test( inp2 );
+	test( inp3 );
+	test( inp4 );
+	return 0;
+}
+
+##### OUTPUT #####
+final
+non-final final
+non-final non-final non-final final non-final
+non-final non-final non-final final
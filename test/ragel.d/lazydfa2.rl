@@ -0,0 +1,65 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --state-limit=16 --lazy-dfa=8
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+%%{
+	machine lazydfa;
+	access st->;
+
+	main :=
+		any* 'a' any any |
+		any* 'b' any any;
+}%%
+
+%% write data;
+%% write state;
+
+/* One cache for both streams. Each stream keeps its own resume set. */
+struct lazydfa_lz_cache lz_cache;
+
+void init( struct lazydfa_state *st )
+{
+	%% write init;
+}
+
+void exec( struct lazydfa_state *st, const char *name, char *data )
+{
+	char *p = data;
+	char *pe = data + strlen( data );
+	%% write exec;
+	printf( "%s %s: %s\n", name, data, st->cs >= lazydfa_first_final ? "final" : "non-final" );
+}
+
+int main( )
+{
+	struct lazydfa_state s1, s2;
+
+	init( &s1 );
+	init( &s2 );
+
+	exec( &s1, "s1", "xxxa" );
+	exec( &s2, "s2", "x" );
+	exec( &s2, "s2", "b" );
+	exec( &s1, "s1", "xx" );
+	exec( &s2, "s2", "x" );
+	exec( &s1, "s1", "y" );
+	exec( &s2, "s2", "x" );
+	exec( &s1, "s1", "ab" );
+	exec( &s2, "s2", "x" );
+	return 0;
+}
+
+##### OUTPUT #####
+s1 xxxa: non-final
+s2 x: non-final
+s2 b: non-final
+s1 xx: final
+s2 x: non-final
+s1 y: non-final
+s2 x: final
+s1 ab: non-final
+s2 x: non-final
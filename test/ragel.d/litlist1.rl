@@ -0,0 +1,43 @@
+/*
+ * @LANG: indep
+ *
+ * Union of literals loaded from a file, with an action attached after.
+ */
+%%{
+	machine litlist1;
+
+	action matched {
+		print_str "matched\n";
+	}
+
+	main := :literals( "litlist1.txt" ): '\n' @matched;
+}%%
+
+##### INPUT #####
+"int\n"
+"in\n"
+"inte\n"
+"interface\n"
+"foreach\n"
+"fo\n"
+"x\n"
+"Int\n"
+"with\n"
+"whil\n"
+##### OUTPUT #####
+matched
+ACCEPT
+matched
+ACCEPT
+FAIL
+matched
+ACCEPT
+matched
+ACCEPT
+FAIL
+matched
+ACCEPT
+FAIL
+matched
+ACCEPT
+FAIL
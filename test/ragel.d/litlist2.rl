@@ -0,0 +1,39 @@
+/*
+ * @LANG: indep
+ *
+ * Case-insensitive union of literals loaded from a file.
+ */
+%%{
+	machine litlist2;
+
+	action matched {
+		print_str "matched\n";
+	}
+
+	main := :literals( "litlist1.txt"i ): '\n' @matched;
+}%%
+
+##### INPUT #####
+"int\n"
+"Int\n"
+"INTERFACE\n"
+"ForEach\n"
+"X\n"
+"WITH\n"
+"Whil\n"
+"inTX\n"
+##### OUTPUT #####
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+matched
+ACCEPT
+FAIL
+FAIL
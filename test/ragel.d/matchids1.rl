@@ -0,0 +1,53 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --match-ids
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+%%{
+	machine sig;
+
+	action match {
+		for ( i = sig_match_offsets[fcurs]; i < sig_match_offsets[fcurs+1]; i++ )
+			printf( "%d at %d\n", (int)sig_match_ids[i], (int)( p - buf ) );
+	}
+
+	main :=
+		any* "ab" |
+		any* "abc" |
+		any* "bc" |
+		any* "x" any "x";
+}%%
+
+%% write data;
+
+void test( char *buf )
+{
+	int cs, i;
+	char *p = buf;
+	char *pe = buf + strlen( buf );
+
+	printf( "%s\n", buf );
+
+	%% write init;
+	%% write exec;
+}
+
+int main()
+{
+	test( "xabcab" );
+	test( "bcxbx" );
+	return 0;
+}
+
+##### OUTPUT #####
+xabcab
+1 at 2
+2 at 3
+3 at 3
+1 at 5
+bcxbx
+3 at 1
+4 at 4
@@ -0,0 +1,90 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --nfa-fallback=2
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+struct nfa_bp_rec
+{
+	long state;
+	char *p;
+	int pop;
+};
+
+struct nfa_bp_rec nfa_bp[1024];
+long nfa_len = 0;
+long nfa_count = 0;
+
+int matched;
+
+%%{
+	machine nfafallback;
+
+	action matched {
+		matched = 1;
+	}
+
+	# Deterministic, the union counts the a's modulo 105. Its operands count
+	# modulo 5, 7 and 3, so it is made an NFA union instead.
+	main :=
+		( 'a'{5} )* 'b' @matched |
+		( 'a'{7} )* 'b' @matched |
+		( 'a'{3} )* 'b' @matched;
+}%%
+
+%% write data;
+
+long total = 0;
+
+void exec( char *data, int len )
+{
+	int cs;
+	char *p = data;
+	char *pe = data + len;
+	char *eof = pe;
+
+	matched = 0;
+	nfa_len = 0;
+	nfa_count = 0;
+
+	%% write init;
+	%% write exec;
+
+	printf( "%s: %s\n", data, matched ? "match" : "no match" );
+	total += nfa_count;
+}
+
+char *inp[] = {
+	"b",
+	"aab",
+	"aaab",
+	"aaaab",
+	"aaaaab",
+	"aaaaaaab",
+	"aaaaaaaaaaab",
+	"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab",
+};
+
+int inplen = 8;
+
+int main( )
+{
+	int i;
+	for ( i = 0; i < inplen; i++ )
+		exec( inp[i], strlen(inp[i]) );
+	printf( "%s\n", total > 0 ? "nfa union" : "dfa union" );
+	return 0;
+}
+
+##### OUTPUT #####
+b: match
+aab: no match
+aaab: match
+aaaab: no match
+aaaaab: match
+aaaaaaab: match
+aaaaaaaaaaab: no match
+aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab: match
+nfa union
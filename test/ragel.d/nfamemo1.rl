@@ -0,0 +1,82 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --nfa-memo
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+struct nfa_bp_rec
+{
+	long state;
+	char *p;
+	int pop;
+};
+
+struct nfa_bp_rec nfa_bp[1024];
+long nfa_len = 0;
+long nfa_count = 0;
+
+/* Bits for each state at each position. */
+unsigned char nfa_memo[4096];
+
+int matched;
+
+%%{
+	machine nfamemo;
+
+	action matched {
+		matched = 1;
+	}
+
+	item |= (0, 0) 'a' | 'aa';
+
+	main := item* 'b' @matched;
+}%%
+
+%% write data;
+int cs;
+
+void exec( char *data, int len )
+{
+	char *p = data;
+	char *pe = data + len;
+	char *eof = pe;
+
+	matched = 0;
+	nfa_len = 0;
+	nfa_count = 0;
+
+	%% write init;
+	%% write exec;
+
+	printf( "%s\n", matched ? "match" : "no match" );
+
+	/* Without the visited set a failing input is tried along exponentially
+	 * many ways of splitting the run of a's. */
+	printf( "%s\n", nfa_count < 1000 ? "bounded" : "unbounded" );
+}
+
+char *inp[] = {
+	"aaab",
+	"aaaaaaaaaaaaaaaaaaaaaaaaaaaaab",
+	"aaaaaaaaaaaaaaaaaaaaaaaaaaaaac",
+};
+
+int inplen = 3;
+
+int main( )
+{
+	int i;
+	for ( i = 0; i < inplen; i++ )
+		exec( inp[i], strlen(inp[i]) );
+	return 0;
+}
+
+##### OUTPUT #####
+match
+bounded
+match
+bounded
+no match
+bounded
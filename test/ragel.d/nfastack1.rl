@@ -0,0 +1,108 @@
+/*
+ * @LANG: c
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+struct nfa_bp_rec
+{
+	long state;
+	char *p;
+	int pop;
+};
+
+long nfa_len = 0;
+long nfa_count = 0;
+
+int matched;
+
+%%{
+	machine bounded;
+
+	action matched {
+		matched = 1;
+	}
+
+	# Two NFA states of two alternatives each on every path.
+	one |= (0, 0) 'a' | 'aa';
+
+	main := one one 'b' @matched;
+}%%
+
+%%{
+	machine cyclic;
+
+	action matched {
+		matched = 1;
+	}
+
+	# The NFA state is on a loop, so the stack has no static bound.
+	one |= (0, 0) 'a' | 'aa';
+
+	main := one* 'b' @matched;
+}%%
+
+%% machine bounded; write data;
+
+/* Ragel writes no bound for the cyclic machine, which would clash with this
+ * one. */
+int cyclic_max_nfa_stack = -1;
+
+%% machine cyclic; write data;
+
+void bounded( char *data )
+{
+	struct nfa_bp_rec nfa_bp[bounded_max_nfa_stack];
+	char *p = data;
+	char *pe = data + strlen( data );
+	char *eof = pe;
+	int cs;
+
+	matched = 0;
+	nfa_len = 0;
+
+	%% machine bounded; write init; write exec;
+
+	printf( "bounded %s: %s\n", data, matched ? "match" : "no match" );
+}
+
+void cyclic( char *data )
+{
+	struct nfa_bp_rec nfa_bp[64];
+	char *p = data;
+	char *pe = data + strlen( data );
+	char *eof = pe;
+	int cs;
+
+	matched = 0;
+	nfa_len = 0;
+
+	%% machine cyclic; write init; write exec;
+
+	printf( "cyclic %s: %s\n", data, matched ? "match" : "no match" );
+}
+
+int main()
+{
+	printf( "max_nfa_stack %d %d\n", bounded_max_nfa_stack,
+			cyclic_max_nfa_stack );
+	bounded( "aab" );
+	bounded( "aaaab" );
+	bounded( "ab" );
+	bounded( "aaaaab" );
+	cyclic( "b" );
+	cyclic( "aaaaab" );
+	cyclic( "aac" );
+	return 0;
+}
+
+##### OUTPUT #####
+max_nfa_stack 4 -1
+bounded aab: match
+bounded aaaab: match
+bounded ab: no match
+bounded aaaaab: no match
+cyclic b: match
+cyclic aaaaab: match
+cyclic aac: no match
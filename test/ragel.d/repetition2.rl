@@ -0,0 +1,74 @@
+/* 
+ * @LANG: indep
+ *
+ * Bounded repetitions large enough to be built from doubled pieces, with
+ * entering and finishing actions on the repeated machine.
+ */
+
+%%{
+	machine rep;
+
+	action begin { print_str "begin\n"; }
+	action in { print_str "in\n"; }
+
+	main := 
+		( 'a' >begin ) {5} '-'
+		( 'b' @in ) {0,6} '-'
+		( 'c' [0-9]? ) {3,7} '\n';
+}%%
+
+##### INPUT #####
+"aaaaa--ccc\n"
+"aaaa--ccc\n"
+"aaaaa-bbbbbb-c1c2c\n"
+"aaaaa-bbbbbbb-ccc\n"
+"aaaaa--c1c2c3c4c5c6c7\n"
+"aaaaa--cccccccc\n"
+##### OUTPUT #####
+begin
+begin
+begin
+begin
+begin
+ACCEPT
+begin
+begin
+begin
+begin
+FAIL
+begin
+begin
+begin
+begin
+begin
+in
+in
+in
+in
+in
+in
+ACCEPT
+begin
+begin
+begin
+begin
+begin
+in
+in
+in
+in
+in
+in
+FAIL
+begin
+begin
+begin
+begin
+begin
+ACCEPT
+begin
+begin
+begin
+begin
+begin
+FAIL
@@ -0,0 +1,81 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --share-tables
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+int res;
+
+/* One and two have the same tables, so two's point at one's. Three differs
+ * in one key and gets its own. */
+
+%%{
+	machine one;
+	main := ( 'ab' | 'cd' )* 'x' @{ res += 1; };
+}%%
+
+%%{
+	machine two;
+	main := ( 'ab' | 'cd' )* 'x' @{ res += 1; };
+}%%
+
+%%{
+	machine three;
+	main := ( 'ab' | 'ce' )* 'x' @{ res += 1; };
+}%%
+
+%% machine one; write data;
+%% machine two; write data;
+%% machine three; write data;
+
+int one( const char *str )
+{
+	const char *p = str, *pe = str + strlen( str );
+	int cs;
+	%% machine one; write init; write exec;
+	return cs >= one_first_final;
+}
+
+int two( const char *str )
+{
+	const char *p = str, *pe = str + strlen( str );
+	int cs;
+	%% machine two; write init; write exec;
+	return cs >= two_first_final;
+}
+
+int three( const char *str )
+{
+	const char *p = str, *pe = str + strlen( str );
+	int cs;
+	%% machine three; write init; write exec;
+	return cs >= three_first_final;
+}
+
+void test( const char *str )
+{
+	int r1, r2, r3;
+
+	res = 0;
+	r1 = one( str );
+	r2 = two( str );
+	r3 = three( str );
+	printf( "%s: %d %d %d %d\n", str, r1, r2, r3, res );
+}
+
+int main()
+{
+	test( "x" );
+	test( "abcdx" );
+	test( "abcex" );
+	test( "abc" );
+	return 0;
+}
+
+##### OUTPUT #####
+x: 1 1 1 3
+abcdx: 1 1 0 2
+abcex: 0 0 1 1
+abc: 0 0 0 0
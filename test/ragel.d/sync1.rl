@@ -0,0 +1,66 @@
+/*
+ * @LANG: c
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+char out[1024];
+
+%%{
+	machine test;
+
+	# A string ends at a quote or at the end of the line, so a newline always
+	# brings the scanner back to the start state.
+	main := |*
+		[a-z]+ => { strcat( out, "w" ); };
+		[0-9]+ => { strcat( out, "n" ); };
+		'"' [^"\n]* ( '"' | '\n' ) => { strcat( out, "s" ); };
+		'\n' => { strcat( out, "|" ); };
+		[ \t]+;
+		any => { strcat( out, "o" ); };
+	*|;
+}%%
+
+%% write data;
+%% write sync;
+
+void scan( const char *p, const char *pe )
+{
+	int cs, act;
+	const char *ts, *te;
+	const char *eof = pe;
+
+	%% write init;
+	%% write exec;
+}
+
+void test( const char *buf )
+{
+	const char *pe = buf + strlen( buf );
+	const char *split = test_find_sync( buf + strlen( buf ) / 2, pe );
+	char serial[1024];
+
+	out[0] = 0;
+	scan( buf, pe );
+	strcpy( serial, out );
+
+	out[0] = 0;
+	scan( buf, split );
+	scan( split, pe );
+
+	printf( "%s %s\n", serial, strcmp( serial, out ) == 0 ? "same" : out );
+}
+
+int main()
+{
+	printf( "num_sync %d\n", test_num_sync );
+	test( "one 2 \"three four\"\nfive \"six\nseven 8\n" );
+	test( "a!b\nc\n\"q\"\n" );
+	return 0;
+}
+
+##### OUTPUT #####
+num_sync 1
+wns|wswn| same
+wow|w|s| same
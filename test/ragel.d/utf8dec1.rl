@@ -0,0 +1,79 @@
+/*
+ * @LANG: c
+ * @RAGEL_FLAGS: --utf8
+ * @PROHIBIT_FLAGS: -T2 -F2 -W0 -W1 -G0 -G1 -G2
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+%%{
+	machine utf8dec;
+
+	main := (
+		( 0 .. 0x7f ) @{ printf( " ascii" ); } |
+		'é' @{ printf( " e-acute" ); } |
+		( 0x10000 .. 0x10ffff ) @{ printf( " astral" ); } |
+		0x110000 @{ printf( " bad" ); } |
+		# An overlong '/' in a literal is not well formed either.
+		'z' @{ printf( " z-bad" ); }
+	)*;
+}%%
+
+%% write data;
+
+void test( char *str )
+{
+	int cs;
+	char *p = str;
+	char *pe = str + strlen( str );
+
+	%% write init;
+	%% write exec;
+
+	printf( "%s\n", cs == utf8dec_error ? " error" : "" );
+}
+
+char *inp[] = {
+	"a/",
+	"\xc3\xa9",
+	"\xf0\x9f\x98\x80",
+	/* Overlong forms of '/'. */
+	"\xc0\xaf",
+	"\xe0\x80\xaf",
+	"\xf0\x80\x80\xaf",
+	/* Surrogates. */
+	"\xed\xa0\x80",
+	"\xed\xbf\xbf",
+	/* One past the last codepoint. */
+	"\xf4\x90\x80\x80",
+	/* A stray continuation byte and a sequence cut off by pe. */
+	"\x80" "a",
+	"a\xe2\x82",
+	/* Matches the literal like any other malformed sequence. */
+	"z\xed\xa0\x80",
+};
+
+int inplen = 12;
+
+int main( )
+{
+	int i;
+	for ( i = 0; i < inplen; i++ )
+		test( inp[i] );
+	return 0;
+}
+
+##### OUTPUT #####
+ ascii ascii
+ e-acute
+ astral
+ bad
+ bad
+ bad
+ bad
+ bad
+ bad
+ bad ascii
+ ascii bad bad
+ ascii bad z-bad
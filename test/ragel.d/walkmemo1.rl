@@ -0,0 +1,93 @@
+/*
+ * @LANG: c
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+char trace[32];
+int len;
+
+#define T( c ) ( trace[len++] = c )
+
+/* The first machine references one definition three times, so the second and
+ * third references are copies of the machine built at the first. The second
+ * writes it out each time and is walked afresh. Each reference has its own
+ * actions and priorities, and the two must behave the same. */
+
+%%{
+	machine memo;
+
+	word = [a-z]+ [0-9];
+
+	main := (
+		word >{ T('<'); } @{ T('a'); } ';' |
+		word $1 @{ T('b'); } ',' |
+		'x' word $2 @{ T('c'); } '.'
+	)*;
+}%%
+
+%%{
+	machine plain;
+
+	main := (
+		( [a-z]+ [0-9] ) >{ T('<'); } @{ T('a'); } ';' |
+		( [a-z]+ [0-9] ) $1 @{ T('b'); } ',' |
+		'x' ( [a-z]+ [0-9] ) $2 @{ T('c'); } '.'
+	)*;
+}%%
+
+%% machine memo; write data;
+%% machine plain; write data;
+
+void memo( const char *str )
+{
+	const char *p = str, *pe = str + strlen( str );
+	int cs;
+
+	memset( trace, 0, sizeof(trace) );
+	len = 0;
+	%% machine memo; write init; write exec;
+	printf( "memo  %s: %s %s\n", str, trace, cs >= memo_first_final ? "ok" : "fail" );
+}
+
+void plain( const char *str )
+{
+	const char *p = str, *pe = str + strlen( str );
+	int cs;
+
+	memset( trace, 0, sizeof(trace) );
+	len = 0;
+	%% machine plain; write init; write exec;
+	printf( "plain %s: %s %s\n", str, trace, cs >= plain_first_final ? "ok" : "fail" );
+}
+
+const char *inp[] = {
+	"ab1;",
+	"ab1,",
+	"xa1.",
+	"xb2;",
+	"a1.",
+};
+
+int main()
+{
+	int i;
+	for ( i = 0; i < 5; i++ ) {
+		memo( inp[i] );
+		plain( inp[i] );
+	}
+	return 0;
+}
+
+##### OUTPUT #####
+memo  ab1;: <ab ok
+plain ab1;: <ab ok
+memo  ab1,: <ab ok
+plain ab1,: <ab ok
+memo  xa1.: <ac ok
+plain xa1.: <ac ok
+memo  xb2;: <ac ok
+plain xb2;: <ac ok
+memo  a1.: <ab fail
+plain a1.: <ab fail
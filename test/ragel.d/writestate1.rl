@@ -0,0 +1,67 @@
+/*
+ * @LANG: c
+ * @PROHIBIT_FLAGS: -G0 -G1
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+%%{
+	machine words;
+	access st->;
+
+	main := |*
+		[a-z]+ => { printf( "word %.*s\n", (int)(te - ts), ts ); };
+		[0-9]+ => { printf( "num %.*s\n", (int)(te - ts), ts ); };
+		' ';
+	*|;
+}%%
+
+%% write data;
+%% write state;
+
+void init( struct words_state *st )
+{
+	%% write init;
+}
+
+void scan( struct words_state *st, const char *data, const char *p,
+		const char *pe, const char *eof )
+{
+	%% write exec;
+}
+
+void test( const char *data, int split )
+{
+	struct words_state st;
+	int len = strlen( data );
+
+	/* The split falls inside a token, which the second call finishes from
+	 * the offsets kept in the struct. */
+	init( &st );
+	scan( &st, data, data, data + split, 0 );
+	scan( &st, data, data + split, data + len, data + len );
+
+	printf( "%s\n", st.cs == words_error ? "error" : "ok" );
+}
+
+int main()
+{
+	printf( "%s\n", sizeof(struct words_state) <= 3 * sizeof(int) ? "small" : "large" );
+	test( "abc 12 de", 5 );
+	test( "abcdef 345", 2 );
+	test( "xy!", 1 );
+	return 0;
+}
+
+##### OUTPUT #####
+small
+word abc
+num 12
+word de
+ok
+word abcdef
+num 345
+ok
+word xy
+error